@@ -0,0 +1,92 @@
+#pragma once
+
+// C interface to the native build of the micro-chain (libeden-micro-chain.so).
+// These are the same entry points the wasm module exports; see
+// eden-micro-chain.cpp and EdenSubchain.ts for their behavior.
+//
+// Functions which produce data store it in a per-thread buffer read with
+// getResult and getResultSize; it remains valid until that thread's next call.
+// No exception leaves these functions. Failures which would trap the wasm
+// module make the function return false, 0, or NULL and put the error
+// message in the result buffer; lastCallFailed then returns true. Functions
+// which produce no value return true on success. lastCallFailed tells
+// failures apart from ordinary false or 0 results, e.g. addBlock ignoring a
+// duplicate block. Functions which change the state may leave it
+// inconsistent when they fail, so hosts should treat those failures as
+// fatal. allocateMemory, freeMemory, getResult, getResultSize, getSchema,
+// getSchemaSize, and freeQuery can't fail. The library has one global state. Queries, getBlock, and
+// getBlockDeltas may run concurrently; functions which change the state wait
+// for them and run alone. A prepared_query may only execute on one thread at
+// a time.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+   struct prepared_query;
+
+   bool initialize(uint32_t eden_account_low,
+                   uint32_t eden_account_high,
+                   uint32_t token_account_low,
+                   uint32_t token_account_high,
+                   uint32_t atomic_account_low,
+                   uint32_t atomic_account_high,
+                   uint32_t atomicmarket_account_low,
+                   uint32_t atomicmarket_account_high);
+
+   void* allocateMemory(uint32_t size);
+   void freeMemory(void* p);
+   uint32_t getResultSize();
+   const char* getResult();
+   bool lastCallFailed();
+
+   bool setReplayMode(bool enabled);
+   bool addEosioBlockJson(const char* json, uint32_t size, uint32_t eosio_irreversible);
+   bool addBlock(const char* data, uint32_t size, uint32_t eosio_irreversible);
+   uint32_t addBlocks(const char* data, uint32_t size, uint32_t eosio_irreversible);
+   bool getShipBlocksRequest(uint32_t block_num);
+   bool pushShipMessage(const char* data, uint32_t size);
+   uint32_t pushShipMessages(const char* data, uint32_t size);
+   uint32_t setIrreversible(uint32_t irreversible);
+   bool trimBlocks();
+   bool undoBlockNum(uint32_t blockNum);
+   bool undoEosioNum(uint32_t eosioNum);
+   bool setBlockDeltaRetention(uint32_t num_blocks);
+   bool getBlockDeltas(uint32_t block_num);
+   bool getBlock(uint32_t num);
+
+   bool saveSnapshot();
+   bool loadSnapshot(const char* data, uint32_t size);
+
+   uint32_t getSchemaSize();
+   const char* getSchema();
+   bool query(const char* query, uint32_t size, const char* variables, uint32_t variables_size);
+   bool queryBin(const char* query, uint32_t size, const char* variables, uint32_t variables_size);
+   bool queryBinToJson(const char* query,
+                       uint32_t size,
+                       const char* variables,
+                       uint32_t variables_size,
+                       const char* data,
+                       uint32_t data_size);
+   uint32_t queryBatch(const char* data, uint32_t size);
+   struct prepared_query* prepareQuery(const char* query, uint32_t size);
+   bool executeQuery(const struct prepared_query* query,
+                     const char* variables,
+                     uint32_t variables_size);
+   void freeQuery(struct prepared_query* query);
+
+   bool setConnectionLimits(uint32_t default_page_size, uint32_t max_page_size);
+   bool setQueryCacheSize(uint32_t max_bytes);
+   bool getQueryCacheStats();
+   bool setQueryStatsEnabled(bool enabled);
+   bool getQueryStats();
+   bool clearQueryStats();
+   bool getMemoryStats();
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,424 @@
+// Replays a recorded history through the native micro-chain and reports
+// ingestion speed, peak memory, undo depth, and query latency.
+//
+// Usage: eden-micro-chain-bench [--catch-up | --replay-mode] history.json [query-iterations]
+//        eden-micro-chain-bench --bulk-load [rows]
+//
+// History files use the dfuse format written by eden_tester::write_dfuse_history;
+// running test-eden produces several (e.g. dfuse-test-election.json). They are
+// pushed the same way the box's dfuse receiver pushes them.
+//
+// --catch-up pushes the history the way a node catching up on old history
+// receives it: blocks which were later undone are dropped, and every block
+// is already irreversible (eosio_irreversible is the last block's number).
+// --replay-mode does the same with setReplayMode(true). Comparing the two
+// measures replay mode's effect on a cold sync.
+//
+// --bulk-load compares filling a table with undo_index::bulk_load, as
+// loadSnapshot does, against emplacing the same rows one at a time.
+
+#include <algorithm>
+#include <boost/multi_index/key.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+#include <chainbase/chainbase.hpp>
+#include <chrono>
+#include <clchain/subchain.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <eden-micro-chain.h>
+#include <eosio/from_json.hpp>
+#include <eosio/to_json.hpp>
+#include <fstream>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <sys/resource.h>
+
+using namespace eosio::literals;
+
+namespace dfuse
+{
+   struct block
+   {
+      uint32_t num;
+      eosio::checksum256 id;
+      eosio::block_timestamp timestamp;
+      eosio::checksum256 previous;
+   };
+   EOSIO_REFLECT(block, num, id, timestamp, previous)
+
+   struct creator_action
+   {
+      double seq;
+      eosio::name receiver;
+   };
+   EOSIO_REFLECT(creator_action, seq, receiver)
+
+   struct action
+   {
+      double seq;
+      eosio::name receiver;
+      eosio::name account;
+      eosio::name name;
+      std::optional<creator_action> creatorAction;
+      eosio::bytes hexData;
+   };
+   EOSIO_REFLECT(action, seq, receiver, account, name, creatorAction, hexData)
+
+   struct trace
+   {
+      eosio::checksum256 id;
+      std::vector<action> matchingActions;
+   };
+   EOSIO_REFLECT(trace, id, matchingActions)
+
+   struct transaction
+   {
+      bool undo = false;
+      std::string cursor;
+      uint32_t irreversibleBlockNum = 0;
+      dfuse::block block;
+      dfuse::trace trace;
+   };
+   EOSIO_REFLECT(transaction, undo, cursor, irreversibleBlockNum, block, trace)
+}  // namespace dfuse
+
+struct block_num
+{
+   uint32_t num = 0;
+};
+EOSIO_REFLECT(block_num, num)
+
+struct block_log_nums
+{
+   std::optional<block_num> head;
+   std::optional<block_num> irreversible;
+};
+EOSIO_REFLECT(block_log_nums, head, irreversible)
+
+struct block_log_data
+{
+   block_log_nums blockLog;
+};
+EOSIO_REFLECT(block_log_data, blockLog)
+
+struct block_log_response
+{
+   block_log_data data;
+};
+EOSIO_REFLECT(block_log_response, data)
+
+// Accounts used by the eden test runners
+constexpr auto eden_account = "eden.gm"_n;
+constexpr auto token_account = "eosio.token"_n;
+constexpr auto atomic_account = "atomicassets"_n;
+constexpr auto atomicmarket_account = "atomicmarket"_n;
+
+const char* bench_queries[] = {
+    "{blockLog{head{num}}}",
+    "{status{active community initialMembers}}",
+    "{members(first:100){edges{node{account balance{amount} profile{name}}}}}",
+    "{membersByCreatedAt(last:20){edges{node{account createdAt}}}}",
+    "{membersSearch(text:\"a\",first:20){edges{node{account}}}}",
+    "{balances(first:100){edges{node{amount history(last:10){edges{node{delta}}}}}}}",
+    "{elections(last:1){edges{node{time rounds{edges{node{groups{edges{node{winner{account}}"
+    "}}}}}}}}}}",
+};
+
+using bench_clock = std::chrono::steady_clock;
+
+double seconds_since(bench_clock::time_point start)
+{
+   return std::chrono::duration<double>(bench_clock::now() - start).count();
+}
+
+std::string_view get_result()
+{
+   return {getResult(), getResultSize()};
+}
+
+// The library doesn't throw; it reports failures through lastCallFailed
+void check_call()
+{
+   eosio::check(!lastCallFailed(), get_result());
+}
+
+void run_query(std::string_view q)
+{
+   query(q.data(), q.size(), nullptr, 0);
+   check_call();
+}
+
+uint32_t undo_depth()
+{
+   run_query("{blockLog{head{num}irreversible{num}}}");
+   std::string json{get_result()};
+   eosio::json_token_stream stream{json.data()};
+   block_log_response response;
+   eosio::from_json(response, stream);
+   auto& log = response.data.blockLog;
+   if (!log.head)
+      return 0;
+   return log.head->num - (log.irreversible ? log.irreversible->num : 0);
+}
+
+using transaction_iterator = std::vector<dfuse::transaction>::const_iterator;
+
+// Transactions which share a block and undo flag
+struct transaction_group
+{
+   transaction_iterator begin;
+   transaction_iterator end;
+};
+
+std::vector<transaction_group> group_transactions(
+    const std::vector<dfuse::transaction>& transactions)
+{
+   std::vector<transaction_group> groups;
+   auto begin = transactions.begin();
+   for (auto it = begin; it != transactions.end(); ++it)
+   {
+      if (it->undo != begin->undo || it->block.id != begin->block.id)
+      {
+         groups.push_back({begin, it});
+         begin = it;
+      }
+   }
+   if (begin != transactions.end())
+      groups.push_back({begin, transactions.end()});
+   return groups;
+}
+
+// The blocks which remain after the history's undos
+std::vector<transaction_group> final_blocks(const std::vector<transaction_group>& groups)
+{
+   std::vector<transaction_group> result;
+   for (auto& group : groups)
+   {
+      if (group.begin->undo)
+         while (!result.empty() && result.back().begin->block.num >= group.begin->block.num)
+            result.pop_back();
+      else
+         result.push_back(group);
+   }
+   return result;
+}
+
+struct replay_stats
+{
+   uint32_t blocks = 0;
+   uint32_t undos = 0;
+   uint64_t actions = 0;
+   uint32_t max_undo_depth = 0;
+   double seconds = 0;
+};
+
+// If irreversible is set, it overrides the history's irreversible block
+void push_group(replay_stats& stats,
+                const transaction_group& group,
+                std::optional<uint32_t> irreversible)
+{
+   auto [begin, end] = group;
+   if (begin->undo)
+   {
+      auto start = bench_clock::now();
+      undoEosioNum(begin->block.num);
+      check_call();
+      stats.seconds += seconds_since(start);
+      ++stats.undos;
+      return;
+   }
+
+   subchain::eosio_block block{
+       .num = begin->block.num,
+       .id = begin->block.id,
+       .previous = begin->block.previous,
+       .timestamp = begin->block.timestamp.to_time_point(),
+   };
+   for (auto it = begin; it != end; ++it)
+   {
+      if (it->trace.matchingActions.empty())
+         continue;
+      auto& trx = block.transactions.emplace_back();
+      trx.id = it->trace.id;
+      for (auto& a : it->trace.matchingActions)
+      {
+         auto& act = trx.actions.emplace_back();
+         act.seq = uint64_t(a.seq);
+         act.firstReceiver = a.account;
+         act.receiver = a.receiver;
+         act.name = a.name;
+         if (a.creatorAction)
+            act.creatorAction = subchain::creator_action{
+                .seq = uint64_t(a.creatorAction->seq), .receiver = a.creatorAction->receiver};
+         act.hexData = a.hexData;
+         ++stats.actions;
+      }
+   }
+   auto json = eosio::convert_to_json(block);
+
+   auto start = bench_clock::now();
+   addEosioBlockJson(json.data(), json.size(),
+                     irreversible.value_or(begin->irreversibleBlockNum));
+   check_call();
+   stats.seconds += seconds_since(start);
+   ++stats.blocks;
+   stats.max_undo_depth = std::max(stats.max_undo_depth, undo_depth());
+}
+
+replay_stats replay(const std::vector<dfuse::transaction>& transactions, bool catch_up)
+{
+   replay_stats stats;
+   auto groups = group_transactions(transactions);
+   std::optional<uint32_t> irreversible;
+   if (catch_up)
+   {
+      groups = final_blocks(groups);
+      if (!groups.empty())
+         irreversible = groups.back().begin->block.num;
+   }
+   for (auto& group : groups)
+      push_group(stats, group, irreversible);
+   return stats;
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+   auto i = std::min(sorted.size() - 1, size_t(p * sorted.size()));
+   return sorted[i];
+}
+
+// A table with a secondary key, like most of the micro-chain's
+struct bench_row : public chainbase::object<0, bench_row>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(bench_row)
+
+   id_type id;
+   uint64_t key = 0;
+};
+using bench_index = chainbase::generic_index<boost::multi_index_container<
+    bench_row,
+    boost::multi_index::indexed_by<
+        boost::multi_index::ordered_unique<boost::multi_index::key<&bench_row::id>>,
+        boost::multi_index::ordered_unique<boost::multi_index::key<&bench_row::key>>>,
+    chainbase::allocator<bench_row>>>;
+
+void bench_bulk_load(uint32_t rows)
+{
+   // Distinct keys in random order, like account names in id order. A regular
+   // pattern (e.g. i * constant) keeps emplace's tree searches in cache.
+   std::vector<uint64_t> keys(rows);
+   for (uint32_t i = 0; i < rows; ++i)
+      keys[i] = i * 0x9E3779B97F4A7C15ull;
+   std::shuffle(keys.begin(), keys.end(), std::mt19937_64{});
+
+   double emplace_seconds;
+   {
+      bench_index table;
+      auto start = bench_clock::now();
+      for (auto key : keys)
+         table.emplace([&](auto& row) { row.key = key; });
+      emplace_seconds = seconds_since(start);
+   }
+
+   double bulk_load_seconds;
+   {
+      bench_index table;
+      auto start = bench_clock::now();
+      uint32_t i = 0;
+      table.bulk_load(rows, [&](auto& row) {
+         row.id = i;
+         row.key = keys[i++];
+      });
+      bulk_load_seconds = seconds_since(start);
+   }
+
+   printf("rows:            %u\n", rows);
+   printf("emplace:         %.3f s\n", emplace_seconds);
+   printf("bulk_load:       %.3f s (%.0f%% of emplace)\n", bulk_load_seconds,
+          100 * bulk_load_seconds / emplace_seconds);
+}
+
+int main(int argc, const char** argv)
+{
+   if (argc >= 2 && argv[1] == std::string_view{"--bulk-load"} && argc <= 3)
+   {
+      bench_bulk_load(argc > 2 ? std::max(1, atoi(argv[2])) : 2'000'000);
+      return 0;
+   }
+   const char* program = argv[0];
+   bool replay_mode = argc >= 2 && argv[1] == std::string_view{"--replay-mode"};
+   bool catch_up = replay_mode || (argc >= 2 && argv[1] == std::string_view{"--catch-up"});
+   if (catch_up)
+   {
+      --argc;
+      ++argv;
+   }
+   if (argc < 2 || argc > 3)
+   {
+      fprintf(stderr,
+              "usage: %s [--catch-up | --replay-mode] history.json [query-iterations]\n"
+              "       %s --bulk-load [rows]\n",
+              program, program);
+      return 1;
+   }
+   uint32_t iterations = argc > 2 ? std::max(1, atoi(argv[2])) : 100;
+
+   try
+   {
+      std::stringstream ss;
+      ss << std::ifstream(argv[1]).rdbuf();
+      auto json = ss.str();
+      eosio::check(!json.empty(), "unable to read " + std::string(argv[1]));
+      std::vector<dfuse::transaction> transactions;
+      eosio::json_token_stream stream{json.data()};
+      eosio::from_json(transactions, stream);
+
+      initialize(uint32_t(eden_account.value), uint32_t(eden_account.value >> 32),
+                 uint32_t(token_account.value), uint32_t(token_account.value >> 32),
+                 uint32_t(atomic_account.value), uint32_t(atomic_account.value >> 32),
+                 uint32_t(atomicmarket_account.value), uint32_t(atomicmarket_account.value >> 32));
+      check_call();
+      if (replay_mode)
+      {
+         setReplayMode(true);
+         check_call();
+      }
+
+      auto stats = replay(transactions, catch_up);
+      printf("blocks:          %u (%u undone)\n", stats.blocks, stats.undos);
+      printf("actions:         %llu\n", (unsigned long long)stats.actions);
+      printf("replay time:     %.3f s\n", stats.seconds);
+      printf("blocks/sec:      %.0f\n", stats.blocks / stats.seconds);
+      printf("actions/sec:     %.0f\n", stats.actions / stats.seconds);
+      printf("max undo depth:  %u blocks\n", stats.max_undo_depth);
+
+      // Measure execution, not cache hits
+      setQueryCacheSize(0);
+      check_call();
+      printf("\nquery latency over %u runs (us): p50 p90 p99 max\n", iterations);
+      for (auto q : bench_queries)
+      {
+         std::vector<double> times;
+         for (uint32_t i = 0; i < iterations; ++i)
+         {
+            auto start = bench_clock::now();
+            run_query(q);
+            times.push_back(seconds_since(start) * 1e6);
+         }
+         std::sort(times.begin(), times.end());
+         printf("%8.1f %8.1f %8.1f %8.1f  %s\n", percentile(times, 0.5), percentile(times, 0.9),
+                percentile(times, 0.99), times.back(), q);
+      }
+
+      rusage usage;
+      getrusage(RUSAGE_SELF, &usage);
+      printf("\npeak memory:     %ld KiB\n", usage.ru_maxrss);
+   }
+   catch (std::exception& e)
+   {
+      fprintf(stderr, "error: %s\n", e.what());
+      return 1;
+   }
+}
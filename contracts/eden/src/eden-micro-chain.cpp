@@ -1,11 +1,16 @@
 #include <accounts.hpp>
+#include <boost/multi_index/hashed_index.hpp>
 #include <boost/multi_index/key.hpp>
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index_container.hpp>
 #include <chainbase/chainbase.hpp>
 #include <clchain/crypto.hpp>
 #include <clchain/graphql_connection.hpp>
+#include <clchain/query_cache.hpp>
+#include <clchain/query_stats.hpp>
 #include <clchain/subchain.hpp>
+#include <clchain/sync.hpp>
+#include <eden-micro-chain.h>
 #include <eden.hpp>
 #include <eosio/abi.hpp>
 #include <eosio/from_bin.hpp>
@@ -16,6 +21,14 @@
 
 using namespace eosio::literals;
 
+// Entry points are wasm exports, or in native builds, C functions declared
+// in eden-micro-chain.h
+#ifdef __wasm__
+#define MICROCHAIN_EXPORT(name) [[clang::export_name(#name)]]
+#else
+#define MICROCHAIN_EXPORT(name) extern "C" __attribute__((visibility("default")))
+#endif
+
 eosio::name eden_account;
 eosio::name token_account;
 eosio::name atomic_account;
@@ -44,42 +57,120 @@ const eosio::ecc_public_key ecc_public_key_max = {
 const eosio::public_key public_key_min_k1{std::in_place_index_t<0>{}, ecc_public_key_min};
 const eosio::public_key public_key_max_r1{std::in_place_index_t<1>{}, ecc_public_key_max};
 
-// TODO: switch to uint64_t (js BigInt) after we upgrade to nodejs >= 15
-extern "C" void __wasm_call_ctors();
-[[clang::export_name("initialize")]] void initialize(uint32_t eden_account_low,
-                                                     uint32_t eden_account_high,
-                                                     uint32_t token_account_low,
-                                                     uint32_t token_account_high,
-                                                     uint32_t atomic_account_low,
-                                                     uint32_t atomic_account_high,
-                                                     uint32_t atomicmarket_account_low,
-                                                     uint32_t atomicmarket_account_high)
+// Entry points which change the state take state_mutex exclusively, and
+// queries share it. This is only a reader/writer lock: readers don't pin a
+// revision, so a slow query still blocks block ingestion, SHiP pushes, and
+// snapshots until it finishes. Writers are preferred, so queries can't
+// starve ingestion.
+clchain::shared_mutex state_mutex;
+using write_lock = clchain::lock_guard<clchain::shared_mutex>;
+using read_lock = clchain::shared_lock<clchain::shared_mutex>;
+
+// Each thread has its own result, so native hosts may call read-only entry
+// points concurrently
+CLCHAIN_THREAD_LOCAL std::variant<std::string, std::vector<char>> result;
+
+// Exceptions must not unwind into a native host. guard_export runs an entry
+// point's body; if it throws, the message goes to result, lastCallFailed
+// returns true, and the entry point returns false, 0, or nullptr. Bodies
+// which return nothing report success as true. In wasm builds, failures trap
+// instead.
+CLCHAIN_THREAD_LOCAL bool last_call_failed = false;
+
+void set_error(const char* message) noexcept
+{
+   last_call_failed = true;
+   try
+   {
+      result = std::string(message);
+   }
+   catch (...)
+   {
+      result = std::string();
+   }
+}
+
+template <typename F>
+auto guard_export(F&& f)
 {
-   __wasm_call_ctors();
-   eden_account.value = (uint64_t(eden_account_high) << 32) | eden_account_low;
-   token_account.value = (uint64_t(token_account_high) << 32) | token_account_low;
-   atomic_account.value = (uint64_t(atomic_account_high) << 32) | atomic_account_low;
-   atomicmarket_account.value =
-       (uint64_t(atomicmarket_account_high) << 32) | atomicmarket_account_low;
+   using body_result = decltype(f());
+   using R = std::conditional_t<std::is_void_v<body_result>, bool, body_result>;
+   auto call = [&]() -> R {
+      if constexpr (std::is_void_v<body_result>)
+      {
+         f();
+         return true;
+      }
+      else
+         return f();
+   };
+#ifdef __wasm__
+   return call();
+#else
+   last_call_failed = false;
+   try
+   {
+      return call();
+   }
+   catch (std::exception& e)
+   {
+      set_error(e.what());
+   }
+   catch (...)
+   {
+      set_error("unknown exception");
+   }
+   return R{};
+#endif
+}
+
+MICROCHAIN_EXPORT(lastCallFailed) bool lastCallFailed()
+{
+   return last_call_failed;
+}
 
-   distribution_fund.value = eden_account.value + 1;
+// TODO: switch to uint64_t (js BigInt) after we upgrade to nodejs >= 15
+#ifdef __wasm__
+extern "C" void __wasm_call_ctors();
+#endif
+MICROCHAIN_EXPORT(initialize) bool initialize(uint32_t eden_account_low,
+                                              uint32_t eden_account_high,
+                                              uint32_t token_account_low,
+                                              uint32_t token_account_high,
+                                              uint32_t atomic_account_low,
+                                              uint32_t atomic_account_high,
+                                              uint32_t atomicmarket_account_low,
+                                              uint32_t atomicmarket_account_high)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+#ifdef __wasm__
+      __wasm_call_ctors();
+#endif
+      eden_account.value = (uint64_t(eden_account_high) << 32) | eden_account_low;
+      token_account.value = (uint64_t(token_account_high) << 32) | token_account_low;
+      atomic_account.value = (uint64_t(atomic_account_high) << 32) | atomic_account_low;
+      atomicmarket_account.value =
+          (uint64_t(atomicmarket_account_high) << 32) | atomicmarket_account_low;
+
+      distribution_fund.value = eden_account.value + 1;
+   });
 }
 
-[[clang::export_name("allocateMemory")]] void* allocateMemory(uint32_t size)
+MICROCHAIN_EXPORT(allocateMemory) void* allocateMemory(uint32_t size)
 {
    return malloc(size);
 }
-[[clang::export_name("freeMemory")]] void freeMemory(void* p)
+MICROCHAIN_EXPORT(freeMemory) void freeMemory(void* p)
 {
    free(p);
 }
 
-std::variant<std::string, std::vector<char>> result;
-[[clang::export_name("getResultSize")]] uint32_t getResultSize()
+MICROCHAIN_EXPORT(getResultSize) uint32_t getResultSize()
 {
    return std::visit([](auto& data) { return data.size(); }, result);
 }
-[[clang::export_name("getResult")]] const char* getResult()
+MICROCHAIN_EXPORT(getResult) const char* getResult()
 {
    return std::visit([](auto& data) { return data.data(); }, result);
 }
@@ -90,6 +181,7 @@ void dump(const T& ind)
    printf("%s\n", eosio::format_json(ind).c_str());
 }
 
+#ifdef BOOST_NO_EXCEPTIONS
 namespace boost
 {
    BOOST_NORETURN void throw_exception(std::exception const& e)
@@ -101,15 +193,21 @@ namespace boost
       eosio::detail::assert_or_throw(e.what());
    }
 }  // namespace boost
+#endif
 
 struct by_id;
 struct by_pk;
+struct by_pk_hash;
 struct by_invitee;
 struct by_group;
 struct by_round;
 struct by_createdAt;
 struct by_member;
 struct by_owner;
+struct by_other;
+struct by_inviter;
+struct by_winner;
+struct by_candidate;
 
 template <typename T, typename... Indexes>
 using mic = boost::
@@ -125,10 +223,17 @@ using ordered_by_pk = boost::multi_index::ordered_unique<  //
     boost::multi_index::tag<by_pk>,
     boost::multi_index::key<&T::by_pk>>;
 
+// Point lookups by account; identity is enough since undo_index mixes the hash
+struct name_hash
+{
+   std::size_t operator()(eosio::name n) const { return n.value; }
+};
+
 template <typename T>
-using ordered_by_invitee = boost::multi_index::ordered_unique<  //
-    boost::multi_index::tag<by_invitee>,
-    boost::multi_index::key<&T::by_invitee>>;
+using hashed_by_pk = boost::multi_index::hashed_unique<  //
+    boost::multi_index::tag<by_pk_hash>,
+    boost::multi_index::key<&T::by_pk>,
+    name_hash>;
 
 template <typename T>
 using ordered_by_group = boost::multi_index::ordered_unique<  //
@@ -155,6 +260,32 @@ using ordered_by_owner = boost::multi_index::ordered_unique<  //
     boost::multi_index::tag<by_owner>,
     boost::multi_index::key<&T::by_owner>>;
 
+template <typename T>
+using ordered_by_winner = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_winner>,
+    boost::multi_index::key<&T::by_winner>>;
+
+template <typename T>
+using ordered_by_candidate = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_candidate>,
+    boost::multi_index::key<&T::by_candidate>>;
+
+// Secondary indexes whose keys may repeat. Rows with equal keys are ordered by id.
+template <typename T>
+using ordered_by_invitee = boost::multi_index::ordered_non_unique<  //
+    boost::multi_index::tag<by_invitee>,
+    boost::multi_index::key<&T::by_invitee>>;
+
+template <typename T>
+using ordered_by_other = boost::multi_index::ordered_non_unique<  //
+    boost::multi_index::tag<by_other>,
+    boost::multi_index::key<&T::by_other>>;
+
+template <typename T>
+using ordered_by_inviter = boost::multi_index::ordered_non_unique<  //
+    boost::multi_index::tag<by_inviter>,
+    boost::multi_index::key<&T::by_inviter>>;
+
 uint64_t available_pk(const auto& table, const auto& first)
 {
    auto& idx = table.template get<by_pk>();
@@ -179,6 +310,8 @@ enum tables
    distribution_fund_table,
    nft_table,
    encryption_key_table,
+   balance_total_table,
+   member_search_table,
 };
 
 struct Induction;
@@ -239,6 +372,21 @@ struct status
       return migrationIndex >= boost::mp11::mp_find<eden::migration_variant, T>::value;
    }
 };
+EOSIO_REFLECT(status,
+              active,
+              community,
+              communitySymbol,
+              minimumDonation,
+              initialMembers,
+              genesisVideo,
+              collectionAttributes,
+              auctionStartingBid,
+              auctionDuration,
+              memo,
+              nextElection,
+              electionThreshold,
+              numElectionParticipants,
+              migrationIndex)
 
 struct status_object : public chainbase::object<status_table, status_object>
 {
@@ -247,6 +395,7 @@ struct status_object : public chainbase::object<status_table, status_object>
    id_type id;
    status status;
 };
+EOSIO_REFLECT(status_object, status)
 using status_index = mic<status_object, ordered_by_id<status_object>>;
 
 // Invariants:
@@ -266,8 +415,11 @@ struct balance_object : public chainbase::object<balance_table, balance_object>
 
    auto by_pk() const { return account; }
 };
-using balance_index =
-    mic<balance_object, ordered_by_id<balance_object>, ordered_by_pk<balance_object>>;
+EOSIO_REFLECT(balance_object, account, amount)
+using balance_index = mic<balance_object,
+                          ordered_by_id<balance_object>,
+                          ordered_by_pk<balance_object>,
+                          hashed_by_pk<balance_object>>;
 
 enum class history_desc
 {
@@ -321,10 +473,38 @@ struct balance_history_object
    history_desc description;
 
    balance_history_key by_pk() const { return {account, time, id._id}; }
+   eosio::name by_other() const { return other_account; }
 };
+EOSIO_REFLECT(balance_history_object, time, account, delta, new_amount, other_account, description)
 using balance_history_index = mic<balance_history_object,
                                   ordered_by_id<balance_history_object>,
-                                  ordered_by_pk<balance_history_object>>;
+                                  ordered_by_pk<balance_history_object>,
+                                  ordered_by_other<balance_history_object>>;
+
+using balance_total_key = std::tuple<eosio::name, history_desc>;
+
+// Invariants:
+// * received - sent, summed across an account's records, matches the balance_object
+//   for that account
+// * Each record summarizes the balance_history_object records with the same account
+//   and description
+struct balance_total_object : public chainbase::object<balance_total_table, balance_total_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(balance_total_object)
+
+   id_type id;
+   eosio::name account;
+   history_desc description;
+   uint32_t count;
+   eosio::asset received;
+   eosio::asset sent;
+
+   balance_total_key by_pk() const { return {account, description}; }
+};
+EOSIO_REFLECT(balance_total_object, account, description, count, received, sent)
+using balance_total_index = mic<balance_total_object,
+                                ordered_by_id<balance_total_object>,
+                                ordered_by_pk<balance_total_object>>;
 
 using InductionEndorser = std::pair<eosio::name, bool>;
 
@@ -339,6 +519,7 @@ struct encryption_key_object : public chainbase::object<encryption_key_table, en
    eosio::name by_pk() const { return account; }
 };
 
+EOSIO_REFLECT(encryption_key_object, account, encryptionKey)
 using encryption_key_index = mic<encryption_key_object,
                                  ordered_by_id<encryption_key_object>,
                                  ordered_by_pk<encryption_key_object>>;
@@ -365,13 +546,16 @@ struct induction_object : public chainbase::object<induction_table, induction_ob
    induction induction;
 
    uint64_t by_pk() const { return induction.id; }
-   std::pair<eosio::name, uint64_t> by_invitee() const { return {induction.invitee, induction.id}; }
+   eosio::name by_invitee() const { return induction.invitee; }
+   eosio::name by_inviter() const { return induction.inviter.first; }
    InductionCreatedAtKey by_createdAt() const { return {induction.createdAt, induction.id}; }
 };
+EOSIO_REFLECT(induction_object, induction)
 using induction_index = mic<induction_object,
                             ordered_by_id<induction_object>,
                             ordered_by_pk<induction_object>,
                             ordered_by_invitee<induction_object>,
+                            ordered_by_inviter<induction_object>,
                             ordered_by_createdAt<induction_object>>;
 
 using MemberCreatedAtKey = std::pair<eosio::block_timestamp, eosio::name>;
@@ -386,6 +570,14 @@ struct member
    bool participating = false;
    eosio::block_timestamp createdAt;
 };
+EOSIO_REFLECT(member,
+              account,
+              inviter,
+              inductionWitnesses,
+              profile,
+              inductionVideo,
+              participating,
+              createdAt)
 
 struct member_object : public chainbase::object<member_table, member_object>
 {
@@ -396,11 +588,82 @@ struct member_object : public chainbase::object<member_table, member_object>
 
    eosio::name by_pk() const { return member.account; }
    MemberCreatedAtKey by_createdAt() const { return {member.createdAt, member.account}; }
+   eosio::name by_inviter() const { return member.inviter; }
 };
+EOSIO_REFLECT(member_object, member)
 using member_index = mic<member_object,
                          ordered_by_id<member_object>,
                          ordered_by_pk<member_object>,
-                         ordered_by_createdAt<member_object>>;
+                         ordered_by_createdAt<member_object>,
+                         ordered_by_inviter<member_object>,
+                         hashed_by_pk<member_object>>;
+
+// Search terms are prefixes of a lowercased name, or of any word in it, truncated
+// to max_search_term_size bytes
+constexpr uint32_t max_search_term_size = 32;
+
+using MemberSearchKey = std::pair<std::string, eosio::name>;
+
+// Lowercases ASCII letters, replaces ASCII punctuation and whitespace with single
+// spaces, and trims. Other bytes, including UTF-8 sequences, are kept.
+std::string normalize_search_text(std::string_view text)
+{
+   std::string result;
+   for (unsigned char c : text)
+   {
+      if (c >= 0x80 || isalnum(c))
+         result.push_back(tolower(c));
+      else if (!result.empty() && result.back() != ' ')
+         result.push_back(' ');
+   }
+   if (!result.empty() && result.back() == ' ')
+      result.pop_back();
+   return result;
+}
+
+void add_search_prefixes(std::vector<std::string>& terms, std::string_view text)
+{
+   for (size_t i = 1; i <= std::min<size_t>(text.size(), max_search_term_size); ++i)
+      if (text[i - 1] != ' ')
+         terms.emplace_back(text.substr(0, i));
+}
+
+std::vector<std::string> member_search_terms(const std::vector<std::string_view>& names)
+{
+   std::vector<std::string> terms;
+   for (auto name : names)
+   {
+      auto text = normalize_search_text(name);
+      std::string_view rest = text;
+      add_search_prefixes(terms, rest);
+      for (auto pos = rest.find(' '); pos != rest.npos; pos = rest.find(' '))
+      {
+         rest.remove_prefix(pos + 1);
+         add_search_prefixes(terms, rest.substr(0, rest.find(' ')));
+      }
+   }
+   std::sort(terms.begin(), terms.end());
+   terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+   return terms;
+}
+
+// Derived from member_table; update_member_search keeps it in sync
+struct member_search_object : public chainbase::object<member_search_table, member_search_object>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(member_search_object)
+
+   id_type id;
+   std::string term;
+   eosio::name account;
+
+   MemberSearchKey by_pk() const { return {term, account}; }
+   std::pair<eosio::name, std::string> by_member() const { return {account, term}; }
+};
+EOSIO_REFLECT(member_search_object, term, account)
+using member_search_index = mic<member_search_object,
+                                ordered_by_id<member_search_object>,
+                                ordered_by_pk<member_search_object>,
+                                ordered_by_member<member_search_object>>;
 
 using SessionKey = std::tuple<eosio::name, eosio::public_key>;
 
@@ -416,6 +679,7 @@ struct session_object : public chainbase::object<session_table, session_object>
 
    SessionKey by_pk() const { return {eden_account, key}; }
 };
+EOSIO_REFLECT(session_object, eden_account, key, expiration, description)
 using session_index =
     mic<session_object, ordered_by_id<session_object>, ordered_by_pk<session_object>>;
 
@@ -436,6 +700,16 @@ struct election_object : public chainbase::object<election_table, election_objec
 
    auto by_pk() const { return time; }
 };
+EOSIO_REFLECT(election_object,
+              time,
+              seeding,
+              results_available,
+              seeding_start_time,
+              seeding_end_time,
+              seed,
+              num_rounds,
+              num_participants,
+              final_group_id)
 using election_index =
     mic<election_object, ordered_by_id<election_object>, ordered_by_pk<election_object>>;
 
@@ -460,6 +734,18 @@ struct election_round_object : public chainbase::object<election_round_table, el
 
    ElectionRoundKey by_round() const { return {election_time, round}; }
 };
+EOSIO_REFLECT(election_round_object,
+              election_time,
+              round,
+              num_participants,
+              num_groups,
+              requires_voting,
+              groups_available,
+              voting_started,
+              voting_finished,
+              results_available,
+              voting_begin,
+              voting_end)
 using election_round_index = mic<election_round_object,
                                  ordered_by_id<election_round_object>,
                                  ordered_by_round<election_round_object>>;
@@ -479,11 +765,14 @@ struct election_group_object : public chainbase::object<election_group_table, el
 
    ElectionGroupKey by_pk() const { return {election_time, round, first_member}; }
    ElectionGroupByRoundKey by_round() const { return {election_time, round, id._id}; }
+   std::pair<eosio::name, uint64_t> by_winner() const { return {winner, id._id}; }
 };
+EOSIO_REFLECT(election_group_object, election_time, round, first_member, winner)
 using election_group_index = mic<election_group_object,
                                  ordered_by_id<election_group_object>,
                                  ordered_by_pk<election_group_object>,
-                                 ordered_by_round<election_group_object>>;
+                                 ordered_by_round<election_group_object>,
+                                 ordered_by_winner<election_group_object>>;
 
 struct vote_object : public chainbase::object<vote_table, vote_object>
 {
@@ -499,11 +788,14 @@ struct vote_object : public chainbase::object<vote_table, vote_object>
 
    vote_key by_pk() const { return {voter, election_time, round}; }
    auto by_group() const { return std::tuple{group_id, voter}; }
+   std::pair<eosio::name, uint64_t> by_candidate() const { return {candidate, id._id}; }
 };
+EOSIO_REFLECT(vote_object, election_time, round, group_id, voter, candidate, video)
 using vote_index = mic<vote_object,
                        ordered_by_id<vote_object>,
                        ordered_by_pk<vote_object>,
-                       ordered_by_group<vote_object>>;
+                       ordered_by_group<vote_object>,
+                       ordered_by_candidate<vote_object>>;
 
 struct distribution_object : public chainbase::object<distribution_table, distribution_object>
 {
@@ -517,6 +809,7 @@ struct distribution_object : public chainbase::object<distribution_table, distri
 
    auto by_pk() const { return time; }
 };
+EOSIO_REFLECT(distribution_object, time, started, target_amount, target_rank_distribution)
 using distribution_index = mic<distribution_object,
                                ordered_by_id<distribution_object>,
                                ordered_by_pk<distribution_object>>;
@@ -537,6 +830,12 @@ struct distribution_fund_object
 
    distribution_fund_key by_pk() const { return {owner, distribution_time, rank}; }
 };
+EOSIO_REFLECT(distribution_fund_object,
+              owner,
+              distribution_time,
+              rank,
+              initial_balance,
+              current_balance)
 using distribution_fund_index = mic<distribution_fund_object,
                                     ordered_by_id<distribution_fund_object>,
                                     ordered_by_pk<distribution_fund_object>>;
@@ -559,6 +858,7 @@ struct nft_object : public chainbase::object<nft_table, nft_object>
    nft_account_key by_member() const { return {member, createdAt, assetId}; }
    nft_account_key by_owner() const { return {owner, createdAt, assetId}; }
 };
+EOSIO_REFLECT(nft_object, member, owner, templateId, assetId, templateMint, createdAt)
 using nft_index = mic<nft_object,
                       ordered_by_id<nft_object>,
                       ordered_by_pk<nft_object>,
@@ -571,9 +871,11 @@ struct database
    chainbase::generic_index<status_index> status;
    chainbase::generic_index<balance_index> balances;
    chainbase::generic_index<balance_history_index> balance_history;
+   chainbase::generic_index<balance_total_index> balance_totals;
    chainbase::generic_index<encryption_key_index> encryption_keys;
    chainbase::generic_index<induction_index> inductions;
    chainbase::generic_index<member_index> members;
+   chainbase::generic_index<member_search_index> member_search;
    chainbase::generic_index<session_index> sessions;
    chainbase::generic_index<election_index> elections;
    chainbase::generic_index<election_round_index> election_rounds;
@@ -588,9 +890,11 @@ struct database
       db.add_index(status);
       db.add_index(balances);
       db.add_index(balance_history);
+      db.add_index(balance_totals);
       db.add_index(encryption_keys);
       db.add_index(inductions);
       db.add_index(members);
+      db.add_index(member_search);
       db.add_index(sessions);
       db.add_index(elections);
       db.add_index(election_rounds);
@@ -600,6 +904,29 @@ struct database
       db.add_index(distribution_funds);
       db.add_index(nfts);
    }
+
+   // Calls f(name, table) for each table. Doesn't include member_search, which
+   // is derived from members. Snapshots and block deltas skip it, and
+   // loadSnapshot rebuilds it.
+   template <typename F>
+   void for_each_table(F&& f)
+   {
+      f("status", status);
+      f("balances", balances);
+      f("balance_history", balance_history);
+      f("balance_totals", balance_totals);
+      f("encryption_keys", encryption_keys);
+      f("inductions", inductions);
+      f("members", members);
+      f("sessions", sessions);
+      f("elections", elections);
+      f("election_rounds", election_rounds);
+      f("election_groups", election_groups);
+      f("votes", votes);
+      f("distributions", distributions);
+      f("distribution_funds", distribution_funds);
+      f("nfts", nfts);
+   }
 };
 database db;
 
@@ -642,6 +969,21 @@ void remove_if_exists(Table& table, const Key& key)
       table.remove(*it);
 }
 
+// Modifies the rows starting at lower_bound(key) for as long as pred holds.
+// f may change the key of the index being walked.
+template <typename Tag, typename Table, typename Key, typename P, typename F>
+void modify_range(Table& table, const Key& key, P&& pred, F&& f)
+{
+   auto& idx = table.template get<Tag>();
+   for (auto it = idx.lower_bound(key); it != idx.end() && pred(*it);)
+   {
+      auto next = it;
+      ++next;
+      table.modify(*it, f);
+      it = next;
+   }
+}
+
 template <typename Tag, typename Table, typename Key>
 const auto& get(Table& table, const Key& key)
 {
@@ -680,6 +1022,18 @@ using BalanceHistoryConnection =
                                                   BalanceHistoryConnection_name,
                                                   BalanceHistoryEdge_name>>;
 
+struct BalanceTotal
+{
+   const balance_total_object* obj;
+
+   std::string description() const { return history_desc_str[(int)obj->description]; }
+   uint32_t count() const { return obj->count; }
+   eosio::asset received() const { return obj->received; }
+   eosio::asset sent() const { return obj->sent; }
+   eosio::asset net() const { return obj->received - obj->sent; }
+};
+EOSIO_REFLECT2(BalanceTotal, description, count, received, sent, net)
+
 struct Balance
 {
    eosio::name _account;
@@ -698,11 +1052,15 @@ struct Balance
                                     std::optional<uint32_t> last,
                                     std::optional<std::string> before,
                                     std::optional<std::string> after) const;
+   std::vector<BalanceTotal> totals() const;
+   std::optional<eosio::asset> amountAt(eosio::block_timestamp time) const;
 };
 EOSIO_REFLECT2(Balance,
                account,
                amount,
-               method(history, "gt", "ge", "lt", "le", "first", "last", "before", "after"))
+               method(history, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
+               totals,
+               method(amountAt, "time"))
 
 constexpr const char BalanceConnection_name[] = "BalanceConnection";
 constexpr const char BalanceEdge_name[] = "BalanceEdge";
@@ -711,7 +1069,7 @@ using BalanceConnection = clchain::Connection<
 
 Balance get_balance(eosio::name account)
 {
-   if (auto* obj = get_ptr<by_pk>(db.balances, account))
+   if (auto* obj = get_ptr<by_pk_hash>(db.balances, account))
       return Balance{account, obj};
    else
       return Balance{account, nullptr};
@@ -757,6 +1115,26 @@ BalanceHistoryConnection Balance::history(std::optional<eosio::block_timestamp>
        [](auto& balance_history, auto key) { return balance_history.upper_bound(key); });
 }
 
+std::vector<BalanceTotal> Balance::totals() const
+{
+   std::vector<BalanceTotal> result;
+   auto& idx = db.balance_totals.get<by_pk>();
+   for (auto it = idx.lower_bound(balance_total_key{_account, history_desc{}});
+        it != idx.end() && it->account == _account; ++it)
+      result.push_back(BalanceTotal{&*it});
+   return result;
+}
+
+// Balance after the last transfer at or before time
+std::optional<eosio::asset> Balance::amountAt(eosio::block_timestamp time) const
+{
+   auto& idx = db.balance_history.get<by_pk>();
+   auto it = idx.upper_bound(balance_history_key{_account, time, ~uint64_t(0)});
+   if (it == idx.begin() || (--it)->account != _account)
+      return std::nullopt;
+   return it->new_amount;
+}
+
 struct EncryptionKey
 {
    eosio::name _account;
@@ -857,7 +1235,7 @@ EOSIO_REFLECT2(
 
 std::optional<Member> get_member(eosio::name account, bool allow_lsb)
 {
-   if (auto* member_object = get_ptr<by_pk>(db.members, account))
+   if (auto* member_object = get_ptr<by_pk_hash>(db.members, account))
       return Member{account, &member_object->member};
    else if (account.value && (!(account.value & 0x0f) || allow_lsb))
       return Member{account, nullptr};
@@ -1348,8 +1726,10 @@ void clearall()
    clear_table(db.status);
    clear_table(db.balances);
    clear_table(db.balance_history);
+   clear_table(db.balance_totals);
    clear_table(db.inductions);
    clear_table(db.members);
+   clear_table(db.member_search);
    clear_table(db.sessions);
    clear_table(db.elections);
    clear_table(db.election_rounds);
@@ -1366,10 +1746,34 @@ void delsession(eosio::name eden_account, const eosio::public_key& key)
    // ignored; events handle session creation and deletion
 }
 
+// Must be called after any change to account's member_object which could affect
+// its search terms
+void update_member_search(eosio::name account)
+{
+   auto& idx = db.member_search.get<by_member>();
+   for (auto it = idx.lower_bound(std::pair{account, std::string{}});
+        it != idx.end() && it->account == account;)
+   {
+      auto next = it;
+      ++next;
+      db.member_search.remove(*it);
+      it = next;
+   }
+   auto* obj = get_ptr<by_pk_hash>(db.members, account);
+   if (!obj)
+      return;
+   auto account_str = account.to_string();
+   for (auto& term : member_search_terms({account_str, obj->member.profile.name}))
+      db.member_search.emplace([&](auto& row) {
+         row.term = std::move(term);
+         row.account = account;
+      });
+}
+
 eosio::asset add_balance(eosio::name account, const eosio::asset& delta)
 {
    eosio::asset result;
-   add_or_modify<by_pk>(db.balances, account, [&](bool is_new, auto& a) {
+   add_or_modify<by_pk_hash>(db.balances, account, [&](bool is_new, auto& a) {
       if (is_new)
       {
          a.account = account;
@@ -1382,6 +1786,26 @@ eosio::asset add_balance(eosio::name account, const eosio::asset& delta)
    return result;
 }
 
+void add_balance_total(eosio::name account, history_desc description, const eosio::asset& delta)
+{
+   add_or_modify<by_pk>(db.balance_totals, balance_total_key{account, description},
+                        [&](bool is_new, auto& t) {
+                           if (is_new)
+                           {
+                              t.account = account;
+                              t.description = description;
+                              t.count = 0;
+                              t.received = eosio::asset{0, delta.symbol};
+                              t.sent = eosio::asset{0, delta.symbol};
+                           }
+                           ++t.count;
+                           if (delta.amount >= 0)
+                              t.received += delta;
+                           else
+                              t.sent -= delta;
+                        });
+}
+
 void transfer_funds(eosio::block_timestamp time,
                     eosio::name from,
                     eosio::name to,
@@ -1390,6 +1814,8 @@ void transfer_funds(eosio::block_timestamp time,
 {
    auto new_from = add_balance(from, -amount);
    auto new_to = add_balance(to, amount);
+   add_balance_total(from, description, -amount);
+   add_balance_total(to, description, amount);
    db.balance_history.emplace([&](auto& h) {
       h.time = time;
       h.account = from;
@@ -1617,12 +2043,13 @@ void inductdonate(const action_context& context,
       if (obj.member.inductionVideo.empty())
          obj.member.inductionVideo = get_status().status.genesisVideo;
    });
+   update_member_search(member.member.account);
 
    transfer_funds(context.block.timestamp, payer, master_pool, quantity,
                   history_desc::inductdonate);
 
    auto& index = db.inductions.get<by_invitee>();
-   for (auto it = index.lower_bound(std::pair<eosio::name, uint64_t>{member.member.account, 0});
+   for (auto it = index.lower_bound(member.member.account);
         it != index.end() && it->induction.invitee == member.member.account;)
    {
       auto next = it;
@@ -1660,6 +2087,7 @@ void inductendors(const action_context& context,
 void resign(eosio::name account)
 {
    remove_if_exists<by_pk>(db.members, account);
+   update_member_search(account);
 }
 
 void rename(eosio::name old_account, eosio::name new_account)
@@ -1671,83 +2099,97 @@ void rename(eosio::name old_account, eosio::name new_account)
    auto update_vec = [&](auto& vec) {
       std::replace(vec.begin(), vec.end(), old_account, new_account);
    };
+   auto contains = [&](const auto& vec, auto proj) {
+      return std::any_of(vec.begin(), vec.end(),
+                         [&](const auto& item) { return proj(item) == old_account; });
+   };
 
    db.status.modify(get_status(), [&](auto& status) { update_vec(status.status.initialMembers); });
 
-   if (auto* obj = get_ptr<by_pk>(db.balances, old_account))
+   if (auto* obj = get_ptr<by_pk_hash>(db.balances, old_account))
       db.balances.modify(*obj, [&](auto& obj) { obj.account = new_account; });
 
-   for (auto& obj : db.balance_history)
-      db.balance_history.modify(obj, [&](auto& obj) {
-         update(obj.account);
-         update(obj.other_account);
-      });
+   modify_range<by_pk>(
+       db.balance_history, balance_history_key{old_account, {}, 0},
+       [&](auto& obj) { return obj.account == old_account; },
+       [&](auto& obj) {
+          update(obj.account);
+          update(obj.other_account);
+       });
+   modify_range<by_other>(
+       db.balance_history, old_account,
+       [&](auto& obj) { return obj.other_account == old_account; },
+       [&](auto& obj) { obj.other_account = new_account; });
+   modify_range<by_pk>(
+       db.balance_totals, balance_total_key{old_account, history_desc{}},
+       [&](auto& obj) { return obj.account == old_account; },
+       [&](auto& obj) { obj.account = new_account; });
 
    if (auto* obj = get_ptr<by_pk>(db.encryption_keys, old_account))
       db.encryption_keys.modify(*obj, [&](auto& obj) { obj.account = new_account; });
 
+   auto update_induction = [&](auto& obj) {
+      update(obj.induction.inviter.first);
+      for (auto& w : obj.induction.witnesses)
+         update(w.first);
+   };
+   modify_range<by_inviter>(
+       db.inductions, old_account,
+       [&](auto& obj) { return obj.induction.inviter.first == old_account; }, update_induction);
+   // Witnesses aren't indexed; inductions only holds pending inductions
    for (auto& obj : db.inductions)
-      db.inductions.modify(obj, [&](auto& obj) {
-         update(obj.induction.inviter.first);
-         for (auto& w : obj.induction.witnesses)
-            update(w.first);
-      });
+      if (contains(obj.induction.witnesses, [](auto& w) { return w.first; }))
+         db.inductions.modify(obj, update_induction);
 
+   auto update_member = [&](auto& obj) {
+      update(obj.member.account);
+      update(obj.member.inviter);
+      update_vec(obj.member.inductionWitnesses);
+   };
+   if (auto* obj = get_ptr<by_pk_hash>(db.members, old_account))
+      db.members.modify(*obj, update_member);
+   modify_range<by_inviter>(
+       db.members, old_account,
+       [&](auto& obj) { return obj.member.inviter == old_account; }, update_member);
+   // Witnesses aren't indexed; this scan doesn't touch the undo stack
    for (auto& obj : db.members)
-      db.members.modify(obj, [&](auto& obj) {
-         update(obj.member.account);
-         update(obj.member.inviter);
-         update_vec(obj.member.inductionWitnesses);
-      });
-
-   for (auto& obj : db.election_groups)
-      db.election_groups.modify(obj, [&](auto& obj) {
-         // first_member is kept as is since it's only used by events
-         // which have already occurred, and it isn't exposed to the UI
-         update(obj.winner);
-      });
-
-   for (auto& obj : db.votes)
-      db.votes.modify(obj, [&](auto& obj) {
-         update(obj.voter);
-         update(obj.candidate);
-      });
-
-   {
-      auto& idx = db.distribution_funds.get<by_pk>();
-      for (auto it = idx.lower_bound(distribution_fund_key{old_account, {}, 0});
-           it != idx.end() && it->owner == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.distribution_funds.modify(*it, [&](auto& obj) { obj.owner = new_account; });
-         it = next;
-      }
-   }
-
-   {
-      auto& idx = db.nfts.get<by_member>();
-      for (auto it = idx.lower_bound(nft_account_key{old_account, {}, 0});
-           it != idx.end() && it->member == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.nfts.modify(*it, [&](auto& obj) { obj.member = new_account; });
-         it = next;
-      }
-   }
-
-   {
-      auto& idx = db.nfts.get<by_owner>();
-      for (auto it = idx.lower_bound(nft_account_key{old_account, {}, 0});
-           it != idx.end() && it->owner == old_account;)
-      {
-         auto next = it;
-         ++next;
-         db.nfts.modify(*it, [&](auto& obj) { obj.owner = new_account; });
-         it = next;
-      }
-   }
+      if (contains(obj.member.inductionWitnesses, [](auto& w) { return w; }))
+         db.members.modify(obj, update_member);
+   update_member_search(old_account);
+   update_member_search(new_account);
+
+   // first_member is kept as is since it's only used by events
+   // which have already occurred, and it isn't exposed to the UI
+   modify_range<by_winner>(
+       db.election_groups, std::pair{old_account, uint64_t(0)},
+       [&](auto& obj) { return obj.winner == old_account; },
+       [&](auto& obj) { obj.winner = new_account; });
+
+   modify_range<by_pk>(
+       db.votes, vote_key{old_account, {}, 0}, [&](auto& obj) { return obj.voter == old_account; },
+       [&](auto& obj) {
+          update(obj.voter);
+          update(obj.candidate);
+       });
+   modify_range<by_candidate>(
+       db.votes, std::pair{old_account, uint64_t(0)},
+       [&](auto& obj) { return obj.candidate == old_account; },
+       [&](auto& obj) { obj.candidate = new_account; });
+
+   modify_range<by_pk>(
+       db.distribution_funds, distribution_fund_key{old_account, {}, 0},
+       [&](auto& obj) { return obj.owner == old_account; },
+       [&](auto& obj) { obj.owner = new_account; });
+
+   modify_range<by_member>(
+       db.nfts, nft_account_key{old_account, {}, 0},
+       [&](auto& obj) { return obj.member == old_account; },
+       [&](auto& obj) { obj.member = new_account; });
+
+   modify_range<by_owner>(
+       db.nfts, nft_account_key{old_account, {}, 0},
+       [&](auto& obj) { return obj.owner == old_account; },
+       [&](auto& obj) { obj.owner = new_account; });
 }  // rename
 
 void clear_participating()
@@ -1761,7 +2203,8 @@ void clear_participating()
 
 void electopt(eosio::name voter, bool participating)
 {
-   modify<by_pk>(db.members, voter, [&](auto& obj) { obj.member.participating = participating; });
+   modify<by_pk_hash>(db.members, voter,
+                      [&](auto& obj) { obj.member.participating = participating; });
    db.status.modify(get_status(), [&](auto& status) {
       status.status.numElectionParticipants += participating ? 1 : -1;
    });
@@ -2153,58 +2596,120 @@ void run(const action_context& context, eosio::input_stream& s)
    eosio::check(!s.remaining(), "unpack error (extra data) within run");
 }
 
+using action_handler = void (*)(const action_context& context, eosio::input_stream& s);
+
+// Which pattern of (firstReceiver, receiver, creator) an action matched.
+// The order of enumerators is the sort order of action_handlers.
+enum class action_source : uint8_t
+{
+   eden,    // firstReceiver is eden_account
+   token,   // token_account notifying eden_account
+   atomic,  // atomic_account notifying eden_account
+   events,  // eosio.null action created by eden_account
+};
+
+std::optional<action_source> get_action_source(eosio::name first_receiver,
+                                               eosio::name receiver,
+                                               eosio::name creator_receiver)
+{
+   if (first_receiver == eden_account)
+      return action_source::eden;
+   if (receiver == eden_account && first_receiver == token_account)
+      return action_source::token;
+   if (receiver == eden_account && first_receiver == atomic_account)
+      return action_source::atomic;
+   if (first_receiver == "eosio.null"_n && creator_receiver == eden_account)
+      return action_source::events;
+   return std::nullopt;
+}
+
+struct action_handler_entry
+{
+   action_source source;
+   eosio::name name;
+   action_handler handler;
+};
+
+// Sorted by (source, name)
+constexpr action_handler_entry action_handlers[] = {
+    {action_source::eden, "addtogenesis"_n, [](auto& c, auto& s) { call(addtogenesis, c, s); }},
+    {action_source::eden, "clearall"_n, [](auto& c, auto& s) { call(clearall, c, s); }},
+    {action_source::eden, "delsession"_n, [](auto& c, auto& s) { call(delsession, c, s); }},
+    {action_source::eden, "donate"_n, [](auto& c, auto& s) { call(donate, c, s); }},
+    {action_source::eden, "electmeeting"_n, [](auto& c, auto& s) { call(electmeeting, c, s); }},
+    {action_source::eden, "electopt"_n, [](auto& c, auto& s) { call(electopt, c, s); }},
+    {action_source::eden, "electvideo"_n, [](auto& c, auto& s) { call(electvideo, c, s); }},
+    {action_source::eden, "electvote"_n, [](auto& c, auto& s) { call(electvote, c, s); }},
+    {action_source::eden, "fundtransfer"_n, [](auto& c, auto& s) { call(fundtransfer, c, s); }},
+    {action_source::eden, "genesis"_n, [](auto& c, auto& s) { call(genesis, c, s); }},
+    {action_source::eden, "inductcancel"_n, [](auto& c, auto& s) { call(inductcancel, c, s); }},
+    {action_source::eden, "inductdonate"_n, [](auto& c, auto& s) { call(inductdonate, c, s); }},
+    {action_source::eden, "inductendors"_n, [](auto& c, auto& s) { call(inductendors, c, s); }},
+    {action_source::eden, "inductinit"_n, [](auto& c, auto& s) { call(inductinit, c, s); }},
+    {action_source::eden, "inductmeetin"_n, [](auto& c, auto& s) { call(inductmeetin, c, s); }},
+    {action_source::eden, "inductprofil"_n, [](auto& c, auto& s) { call(inductprofil, c, s); }},
+    {action_source::eden, "inductvideo"_n, [](auto& c, auto& s) { call(inductvideo, c, s); }},
+    {action_source::eden, "rename"_n, [](auto& c, auto& s) { call(rename, c, s); }},
+    {action_source::eden, "resign"_n, [](auto& c, auto& s) { call(resign, c, s); }},
+    {action_source::eden, "run"_n, [](auto& c, auto& s) { run(c, s); }},
+    {action_source::eden, "setencpubkey"_n, [](auto& c, auto& s) { call(setencpubkey, c, s); }},
+    {action_source::eden, "transfer"_n, [](auto& c, auto& s) { call(transfer, c, s); }},
+    {action_source::eden, "usertransfer"_n, [](auto& c, auto& s) { call(usertransfer, c, s); }},
+    {action_source::eden, "withdraw"_n, [](auto& c, auto& s) { call(withdraw, c, s); }},
+    {action_source::token, "transfer"_n, [](auto& c, auto& s) { call(notify_transfer, c, s); }},
+    {action_source::atomic, "logmint"_n, [](auto& c, auto& s) { call(logmint, c, s); }},
+    {action_source::atomic, "logtransfer"_n, [](auto& c, auto& s) { call(logtransfer, c, s); }},
+    {action_source::events, "eden.events"_n,
+     [](auto& c, auto& s) {
+        // TODO: prevent abort, indicate what failed
+        std::vector<eden::event> events;
+        eosio::from_bin(events, s);
+        for (auto& event : events)
+           handle_event(c, event);
+     }},
+};
+
+constexpr auto action_handler_key(const action_handler_entry& entry)
+{
+   return std::pair{entry.source, entry.name.value};
+}
+
+constexpr bool action_handlers_sorted()
+{
+   for (size_t i = 1; i < std::size(action_handlers); ++i)
+      if (!(action_handler_key(action_handlers[i - 1]) < action_handler_key(action_handlers[i])))
+         return false;
+   return true;
+}
+static_assert(action_handlers_sorted(), "action_handlers must be sorted by (source, name)");
+
+action_handler get_action_handler(action_source source, eosio::name name)
+{
+   auto key = std::pair{source, name.value};
+   auto it = std::lower_bound(
+       std::begin(action_handlers), std::end(action_handlers), key,
+       [](const auto& entry, const auto& key) { return action_handler_key(entry) < key; });
+   if (it != std::end(action_handlers) && action_handler_key(*it) == key)
+      return it->handler;
+   return nullptr;
+}
+
+action_handler get_action_handler(eosio::name first_receiver,
+                                  eosio::name receiver,
+                                  eosio::name name,
+                                  eosio::name creator_receiver)
+{
+   if (auto source = get_action_source(first_receiver, receiver, creator_receiver))
+      return get_action_handler(*source, name);
+   return nullptr;
+}
+
 bool dispatch(eosio::name action_name, const action_context& context, eosio::input_stream& s)
 {
-   if (action_name == "run"_n)
-      run(context, s);
-   else if (action_name == "clearall"_n)
-      call(clearall, context, s);
-   else if (action_name == "delsession"_n)
-      call(delsession, context, s);
-   else if (action_name == "withdraw"_n)
-      call(withdraw, context, s);
-   else if (action_name == "donate"_n)
-      call(donate, context, s);
-   else if (action_name == "transfer"_n)
-      call(transfer, context, s);
-   else if (action_name == "fundtransfer"_n)
-      call(fundtransfer, context, s);
-   else if (action_name == "usertransfer"_n)
-      call(usertransfer, context, s);
-   else if (action_name == "genesis"_n)
-      call(genesis, context, s);
-   else if (action_name == "addtogenesis"_n)
-      call(addtogenesis, context, s);
-   else if (action_name == "inductinit"_n)
-      call(inductinit, context, s);
-   else if (action_name == "inductprofil"_n)
-      call(inductprofil, context, s);
-   else if (action_name == "inductmeetin"_n)
-      call(inductmeetin, context, s);
-   else if (action_name == "inductvideo"_n)
-      call(inductvideo, context, s);
-   else if (action_name == "inductcancel"_n)
-      call(inductcancel, context, s);
-   else if (action_name == "inductdonate"_n)
-      call(inductdonate, context, s);
-   else if (action_name == "inductendors"_n)
-      call(inductendors, context, s);
-   else if (action_name == "resign"_n)
-      call(resign, context, s);
-   else if (action_name == "rename"_n)
-      call(rename, context, s);
-   else if (action_name == "electopt"_n)
-      call(electopt, context, s);
-   else if (action_name == "electvote"_n)
-      call(electvote, context, s);
-   else if (action_name == "electmeeting"_n)
-      call(electmeeting, context, s);
-   else if (action_name == "electvideo"_n)
-      call(electvideo, context, s);
-   else if (action_name == "setencpubkey"_n)
-      call(setencpubkey, context, s);
-   else
+   auto handler = get_action_handler(action_source::eden, action_name);
+   if (!handler)
       return false;
+   handler(context, s);
    return true;
 }
 
@@ -2215,34 +2720,14 @@ void filter_block(const subchain::eosio_block& block)
    {
       for (auto& action : trx.actions)
       {
+         auto handler = get_action_handler(
+             action.firstReceiver, action.receiver, action.name,
+             action.creatorAction ? action.creatorAction->receiver : eosio::name{});
+         if (!handler)
+            continue;
          action_context context{block, block_state, trx, action};
-         if (action.firstReceiver == eden_account)
-         {
-            eosio::input_stream s(action.hexData.data);
-            dispatch(action.name, context, s);
-         }
-         else if (action.firstReceiver == token_account && action.receiver == eden_account &&
-                  action.name == "transfer"_n)
-         {
-            eosio::input_stream s(action.hexData.data);
-            call(notify_transfer, context, s);
-         }
-         else if (action.firstReceiver == "eosio.null"_n && action.name == "eden.events"_n &&
-                  action.creatorAction && action.creatorAction->receiver == eden_account)
-         {
-            // TODO: prevent abort, indicate what failed
-            auto events = eosio::convert_from_bin<std::vector<eden::event>>(action.hexData.data);
-            for (auto& event : events)
-               handle_event(context, event);
-         }
-         else if (action.firstReceiver == atomic_account && action.receiver == eden_account)
-         {
-            eosio::input_stream s(action.hexData.data);
-            if (action.name == "logmint"_n)
-               call(logmint, context, s);
-            else if (action.name == "logtransfer"_n)
-               call(logtransfer, context, s);
-         }
+         eosio::input_stream s(action.hexData.data);
+         handler(context, s);
       }  // for(action)
 
       // garbage collection housekeeping
@@ -2253,77 +2738,150 @@ void filter_block(const subchain::eosio_block& block)
    }  // for(trx)
 }  // filter_block
 
-std::vector<subchain::transaction> ship_to_eden_transactions(
-    std::vector<eosio::ship_protocol::transaction_trace>& traces)
+std::vector<subchain::transaction> ship_to_eden_transactions(eosio::input_stream traces)
 {
+   static std::vector<eosio::ship_protocol::action_trace_view> views;
    std::vector<subchain::transaction> transactions;
+   if (!traces.remaining())
+      return transactions;
 
-   for (const auto& transaction_trace : traces)
-   {
-      std::visit(
-          [&](const auto& trx_trace) {
-             subchain::transaction transaction{
-                 .id = trx_trace.id,
-             };
+   eosio::ship_protocol::for_each_transaction_trace(
+       traces, views, [&](const eosio::checksum256& id, const auto& action_traces) {
+          std::optional<subchain::transaction> transaction;
 
-             for (const auto& action_trace : trx_trace.action_traces)
+          for (const auto& act_trace : action_traces)
+          {
+             if (!act_trace.global_sequence)
+                continue;
+
+             std::optional<subchain::creator_action> creatorAction;
+             if (act_trace.creator_action_ordinal > 0)
              {
-                std::visit(
-                    [&](const auto& act_trace) {
-                       std::optional<subchain::creator_action> creatorAction;
-                       if (act_trace.creator_action_ordinal.value > 0)
-                       {
-                          std::visit(
-                              [&](const auto& creator_action_trace) {
-                                 std::visit(
-                                     [&](const auto& receipt) {
-                                        creatorAction = subchain::creator_action{
-                                            .seq = receipt.global_sequence,
-                                            .receiver = creator_action_trace.receiver,
-                                        };
-                                     },
-                                     *creator_action_trace.receipt);
-                              },
-                              trx_trace.action_traces[act_trace.creator_action_ordinal.value - 1]);
-                       }
-
-                       std::vector<char> data(act_trace.act.data.pos, act_trace.act.data.end);
-                       eosio::bytes hexData{data};
-
-                       std::visit(
-                           [&](const auto& receipt) {
-                              subchain::action action{
-                                  .seq = receipt.global_sequence,
-                                  .firstReceiver = act_trace.act.account,
-                                  .receiver = act_trace.receiver,
-                                  .name = act_trace.act.name,
-                                  .creatorAction = creatorAction,
-                                  .hexData = std::move(hexData),
-                              };
-
-                              transaction.actions.push_back(std::move(action));
-                           },
-                           *act_trace.receipt);
-                    },
-                    action_trace);
+                eosio::check(act_trace.creator_action_ordinal <= action_traces.size(),
+                             "invalid creator_action_ordinal");
+                const auto& creator_action_trace =
+                    action_traces[act_trace.creator_action_ordinal - 1];
+                if (creator_action_trace.global_sequence)
+                   creatorAction = subchain::creator_action{
+                       .seq = *creator_action_trace.global_sequence,
+                       .receiver = creator_action_trace.receiver,
+                   };
              }
 
-             transactions.push_back(std::move(transaction));
-          },
-          transaction_trace);
-   }
+             // Drop actions which filter_block would ignore before
+             // copying their data
+             if (!get_action_handler(act_trace.account, act_trace.receiver, act_trace.name,
+                                     creatorAction ? creatorAction->receiver : eosio::name{}))
+                continue;
+             if (!transaction)
+                transaction.emplace(subchain::transaction{.id = id});
+
+             transaction->actions.push_back(subchain::action{
+                 .seq = *act_trace.global_sequence,
+                 .firstReceiver = act_trace.account,
+                 .receiver = act_trace.receiver,
+                 .name = act_trace.name,
+                 .creatorAction = creatorAction,
+                 .hexData = {{act_trace.data.pos, act_trace.data.end}},
+             });
+          }
+
+          if (transaction)
+             transactions.push_back(std::move(*transaction));
+       });
 
    return transactions;
 }
 
 subchain::block_log block_log;
 
+// Results of recent queries. Anything which changes block_log or the database
+// must clear it.
+clchain::query_cache query_cache;
+
+// Row changes made by the most recent reversible blocks, in this format:
+//    number of changed tables (varuint32)
+//    for each changed table, in database::for_each_table order:
+//       type_id (uint16)
+//       created rows: count (varuint32), then id and reflected fields of each
+//       modified rows: count (varuint32), then id and new reflected fields of each
+//       removed rows: count (varuint32), then id of each
+// Rows use the same encoding as snapshots.
+struct block_delta
+{
+   uint32_t num;
+   std::vector<char> data;
+};
+std::deque<block_delta> block_deltas;
+uint32_t block_delta_retention = 0;
+
+template <typename Table, typename S>
+void write_table_delta(const Table& table, S& stream)
+{
+   auto delta = table.last_undo_session();
+   if (delta.new_values.empty() && delta.old_values.empty() && delta.removed_values.empty())
+      return;
+   uint16_t type_id = Table::value_type::type_id;
+   eosio::to_bin(type_id, stream);
+   eosio::varuint32_to_bin(std::distance(delta.new_values.begin(), delta.new_values.end()),
+                           stream);
+   for (auto& obj : delta.new_values)
+   {
+      eosio::to_bin(obj.id._id, stream);
+      eosio::to_bin(obj, stream);
+   }
+   eosio::varuint32_to_bin(std::distance(delta.old_values.begin(), delta.old_values.end()),
+                           stream);
+   for (auto& old : delta.old_values)
+   {
+      eosio::to_bin(old.id._id, stream);
+      eosio::to_bin(table.get(old.id), stream);
+   }
+   eosio::varuint32_to_bin(
+       std::distance(delta.removed_values.begin(), delta.removed_values.end()), stream);
+   for (auto& obj : delta.removed_values)
+      eosio::to_bin(obj.id._id, stream);
+}
+
+template <typename S>
+void write_block_delta(S& stream)
+{
+   uint32_t num_tables = 0;
+   db.for_each_table([&](const char*, auto& table) {
+      auto delta = table.last_undo_session();
+      num_tables += !delta.new_values.empty() || !delta.old_values.empty() ||
+                    !delta.removed_values.empty();
+   });
+   eosio::varuint32_to_bin(num_tables, stream);
+   db.for_each_table([&](const char*, auto& table) { write_table_delta(table, stream); });
+}
+
+// Must be called while the block's undo session is on top of the stack
+void record_block_delta(uint32_t num)
+{
+   if (!block_delta_retention)
+      return;
+   while (!block_deltas.empty() && block_deltas.back().num >= num)
+      block_deltas.pop_back();
+   eosio::size_stream ss;
+   write_block_delta(ss);
+   auto& delta = block_deltas.emplace_back(block_delta{num, std::vector<char>(ss.size)});
+   eosio::fixed_buf_stream fbs(delta.data.data(), delta.data.size());
+   write_block_delta(fbs);
+   while (block_deltas.size() > block_delta_retention)
+      block_deltas.pop_front();
+}
+
 void forked_n_blocks(size_t n)
 {
+   query_cache.clear();
    if (n)
       printf("forked %d blocks, %d now in log\n", (int)n, (int)block_log.blocks.size());
    while (n--)
       db.db.undo();
+   auto* head = block_log.head();
+   while (!block_deltas.empty() && (!head || block_deltas.back().num > head->num))
+      block_deltas.pop_back();
 }
 
 bool add_block(subchain::block_with_id&& bi, uint32_t eosio_irreversible)
@@ -2331,6 +2889,7 @@ bool add_block(subchain::block_with_id&& bi, uint32_t eosio_irreversible)
    auto [status, num_forked] = block_log.add_block(bi);
    if (status)
       return false;
+   query_cache.clear();
    forked_n_blocks(num_forked);
    if (auto* b = block_log.block_before_eosio_num(eosio_irreversible + 1))
       block_log.irreversible = std::max(block_log.irreversible, b->num);
@@ -2339,7 +2898,9 @@ bool add_block(subchain::block_with_id&& bi, uint32_t eosio_irreversible)
    auto session = db.db.start_undo_session(bi.num > block_log.irreversible);
    filter_block(bi.eosioBlock);
    session.push();
-   if (!need_undo)
+   if (need_undo)
+      record_block_delta(bi.num);
+   else
       db.db.set_revision(bi.num);
    // printf("%s block: %d %d log: %d irreversible: %d db: %d-%d %s\n", block_log.status_str[status],
    //        (int)bi.eosioBlock.num, (int)bi.num, (int)block_log.blocks.size(),
@@ -2350,20 +2911,95 @@ bool add_block(subchain::block_with_id&& bi, uint32_t eosio_irreversible)
    return true;
 }
 
-bool add_block(subchain::block&& eden_block, uint32_t eosio_irreversible)
+// Serializes the block once. If bin is non-null, it receives the serialized
+// block_with_id: the block is written after room for the id, then hashed in
+// place. Otherwise the serialized block goes straight to the hasher.
+subchain::block_with_id make_block_with_id(subchain::block&& eden_block,
+                                           std::vector<char>* bin = nullptr)
 {
-   auto bin = eosio::convert_to_bin(eden_block);
    subchain::block_with_id bi;
+   if (bin)
+   {
+      constexpr uint32_t id_size = sizeof(bi.id.extract_as_byte_array());
+      eosio::size_stream size;
+      eosio::to_bin(eden_block, size);
+      bin->resize(id_size + size.size);
+      eosio::fixed_buf_stream stream{bin->data() + id_size, size.size};
+      eosio::to_bin(eden_block, stream);
+      bi.id = clchain::sha256(bin->data() + id_size, size.size);
+      eosio::fixed_buf_stream id_stream{bin->data(), id_size};
+      eosio::to_bin(bi.id, id_stream);
+   }
+   else
+   {
+      clchain::sha256_hasher hasher;
+      eosio::hash_stream stream{hasher};
+      eosio::to_bin(eden_block, stream);
+      bi.id = hasher.finish();
+   }
    static_cast<subchain::block&>(bi) = std::move(eden_block);
-   bi.id = clchain::sha256(bin.data(), bin.size());
-   auto bin_with_id = eosio::convert_to_bin(bi.id);
-   bin_with_id.insert(bin_with_id.end(), bin.begin(), bin.end());
-   result = std::move(bin_with_id);
-   return add_block(std::move(bi), eosio_irreversible);
+   return bi;
+}
+
+bool add_block(subchain::block&& eden_block,
+               uint32_t eosio_irreversible,
+               std::vector<char>* bin = nullptr)
+{
+   return add_block(make_block_with_id(std::move(eden_block), bin), eosio_irreversible);
+}
+
+// Replay mode speeds up catching up on irreversible history. Blocks at or
+// below eosio_irreversible are applied straight to the database with undo
+// disabled, and block_log only keeps the head block. Normal processing
+// resumes once blocks become reversible.
+bool replay_mode = false;
+
+MICROCHAIN_EXPORT(setReplayMode) bool setReplayMode(bool enabled)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      replay_mode = enabled;
+   });
+}
+
+bool replay_block(subchain::eosio_block& eosioBlock,
+                  uint32_t eosio_irreversible,
+                  std::vector<char>* bin)
+{
+   auto* head = block_log.head();
+   if (!replay_mode || eosioBlock.num > eosio_irreversible ||
+       db.db.undo_stack_revision_range().first != db.db.revision() ||
+       (head && (head->num != block_log.irreversible || head->eosioBlock.num >= eosioBlock.num)))
+      return false;
+
+   subchain::block eden_block;
+   eden_block.eosioBlock = std::move(eosioBlock);
+   if (head)
+   {
+      eden_block.num = head->num + 1;
+      eden_block.previous = head->id;
+   }
+   else
+      eden_block.num = 1;
+
+   query_cache.clear();
+   filter_block(eden_block.eosioBlock);
+   db.db.set_revision(eden_block.num);
+   block_log.irreversible = eden_block.num;
+   block_log.blocks.clear();
+   block_log.blocks.push_back(
+       std::make_unique<subchain::block_with_id>(make_block_with_id(std::move(eden_block), bin)));
+   return true;
 }
 
-bool add_block(subchain::eosio_block&& eosioBlock, uint32_t eosio_irreversible)
+// If bin is non-null, it receives the serialized block_with_id
+bool add_block(subchain::eosio_block&& eosioBlock,
+               uint32_t eosio_irreversible,
+               std::vector<char>* bin = nullptr)
 {
+   if (replay_block(eosioBlock, eosio_irreversible, bin))
+      return true;
+
    subchain::block eden_block;
    eden_block.eosioBlock = std::move(eosioBlock);
 
@@ -2376,14 +3012,14 @@ bool add_block(subchain::eosio_block&& eosioBlock, uint32_t eosio_irreversible)
    else
       eden_block.num = 1;
 
-   return add_block(std::move(eden_block), eosio_irreversible);
+   return add_block(std::move(eden_block), eosio_irreversible, bin);
 }
 
-bool add_block(eosio::ship_protocol::block_position block,
-               eosio::ship_protocol::block_position prev,
+bool add_block(const eosio::ship_protocol::block_position& block,
+               const eosio::ship_protocol::block_position& prev,
                uint32_t eosio_irreversible,
                eosio::block_timestamp timestamp,
-               std::vector<eosio::ship_protocol::transaction_trace> traces)
+               eosio::input_stream traces)
 {
    subchain::eosio_block eosio_block;
    eosio_block.num = block.block_num;
@@ -2395,107 +3031,341 @@ bool add_block(eosio::ship_protocol::block_position block,
 }
 
 // TODO: prevent from_json from aborting
-[[clang::export_name("addEosioBlockJson")]] bool addEosioBlockJson(const char* json,
-                                                                   uint32_t size,
-                                                                   uint32_t eosio_irreversible)
-{
-   std::string str(json, size);
-   eosio::json_token_stream s(str.data());
-   subchain::eosio_block eosio_block;
-   eosio::from_json(eosio_block, s);
-   return add_block(std::move(eosio_block), eosio_irreversible);
-   // printf("%d blocks processed, %d blocks now in log\n", (int)eosio_blocks.size(),
-   //        (int)block_log.blocks.size());
-   // for (auto& b : block_log.blocks)
-   //    printf("%d\n", (int)b->num);
+MICROCHAIN_EXPORT(addEosioBlockJson) bool addEosioBlockJson(const char* json,
+                                                            uint32_t size,
+                                                            uint32_t eosio_irreversible)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      std::string str(json, size);
+      eosio::json_token_stream s(str.data());
+      subchain::eosio_block eosio_block;
+      eosio::from_json(eosio_block, s);
+      std::vector<char> bin;
+      if (!add_block(std::move(eosio_block), eosio_irreversible, &bin))
+         return false;
+      result = std::move(bin);
+      return true;
+      // printf("%d blocks processed, %d blocks now in log\n", (int)eosio_blocks.size(),
+      //        (int)block_log.blocks.size());
+      // for (auto& b : block_log.blocks)
+      //    printf("%d\n", (int)b->num);
+   });
 }
 
 // TODO: prevent from_bin from aborting
-[[clang::export_name("addBlock")]] bool addBlock(const char* data,
-                                                 uint32_t size,
-                                                 uint32_t eosio_irreversible)
+MICROCHAIN_EXPORT(addBlock) bool addBlock(const char* data,
+                                          uint32_t size,
+                                          uint32_t eosio_irreversible)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      // TODO: verify id integrity
+      eosio::input_stream bin{data, size};
+      subchain::block_with_id block;
+      eosio::from_bin(block, bin);
+      return add_block(std::move(block), eosio_irreversible);
+   });
+}
+
+MICROCHAIN_EXPORT(getShipBlocksRequest) bool getShipBlocksRequest(uint32_t block_num)
 {
-   // TODO: verify id integrity
-   eosio::input_stream bin{data, size};
-   subchain::block_with_id block;
-   eosio::from_bin(block, bin);
-   return add_block(std::move(block), eosio_irreversible);
+   return guard_export([&] {
+      eosio::ship_protocol::request request = eosio::ship_protocol::get_blocks_request_v0{
+          .start_block_num = block_num,
+          .end_block_num = 0xffff'ffff,
+          .max_messages_in_flight = 0xffff'ffff,
+          .fetch_block = true,
+          .fetch_traces = true,
+      };
+      result = eosio::convert_to_bin(request);
+
+      return true;
+   });
 }
 
-[[clang::export_name("getShipBlocksRequest")]] bool getShipBlocksRequest(uint32_t block_num)
+// The block and traces are decoded in place; only the header fields and the
+// actions which filter_block handles are extracted.
+bool push_ship_message(eosio::input_stream bin)
 {
-   eosio::ship_protocol::request request = eosio::ship_protocol::get_blocks_request_v0{
-       .start_block_num = block_num,
-       .end_block_num = 0xffff'ffff,
-       .max_messages_in_flight = 0xffff'ffff,
-       .fetch_block = true,
-       .fetch_traces = true,
-   };
-   result = eosio::convert_to_bin(request);
+   if (eosio::varuint32_from_bin(bin) != 1)  // get_blocks_result_v0
+      return false;
+   eosio::ship_protocol::get_blocks_result_v0 blocks_result;
+   eosio::from_bin(blocks_result, bin);
+   if (!blocks_result.this_block)
+      return false;
 
-   return true;
+   eosio::block_timestamp timestamp;
+   if (blocks_result.block)
+      timestamp = eosio::ship_protocol::get_block_timestamp(*blocks_result.block);
+
+   auto prev_block = blocks_result.prev_block ? *blocks_result.prev_block
+                                              : eosio::ship_protocol::block_position{};
+
+   return add_block(*blocks_result.this_block, prev_block,
+                    blocks_result.last_irreversible.block_num, timestamp,
+                    blocks_result.traces ? *blocks_result.traces : eosio::input_stream{});
 }
 
-[[clang::export_name("pushShipMessage")]] bool pushShipMessage(const char* data, uint32_t size)
+MICROCHAIN_EXPORT(pushShipMessage) bool pushShipMessage(const char* data, uint32_t size)
 {
-   eosio::input_stream bin{data, size};
-   eosio::ship_protocol::result result;
-   eosio::from_bin(result, bin);
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      return push_ship_message({data, size});
+   });
+}
 
-   if (auto* blocks_result = std::get_if<eosio::ship_protocol::get_blocks_result_v0>(&result))
+// Batches are a sequence of messages, each prefixed by its uint32_t size.
+// The result holds one status byte per message: 1 if the block was
+// added, 0 if it was ignored (duplicate, unlinkable, or not a block).
+template <typename F>
+uint32_t push_batch(const char* data, uint32_t size, F&& push)
+{
+   eosio::input_stream stream{data, size};
+   std::vector<char> statuses;
+   while (stream.remaining())
    {
-      eosio::ship_protocol::signed_block signed_block;
-      if (blocks_result->block)
-      {
-         eosio::from_bin(signed_block, blocks_result->block.value());
-      }
+      uint32_t message_size;
+      eosio::from_bin(message_size, stream);
+      stream.check_available(message_size);
+      statuses.push_back(push(eosio::input_stream{stream.pos, message_size}));
+      stream.skip(message_size);
+   }
+   uint32_t num_added = std::count(statuses.begin(), statuses.end(), 1);
+   result = std::move(statuses);
+   return num_added;
+}
 
-      std::vector<eosio::ship_protocol::transaction_trace> traces;
-      if (blocks_result->traces)
+MICROCHAIN_EXPORT(pushShipMessages) uint32_t pushShipMessages(const char* data, uint32_t size)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      return push_batch(data, size, push_ship_message);
+   });
+}
+
+// TODO: prevent from_bin from aborting
+MICROCHAIN_EXPORT(addBlocks) uint32_t addBlocks(const char* data,
+                                                uint32_t size,
+                                                uint32_t eosio_irreversible)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      return push_batch(data, size, [&](eosio::input_stream bin) {
+         subchain::block_with_id block;
+         eosio::from_bin(block, bin);
+         return add_block(std::move(block), eosio_irreversible);
+      });
+   });
+}
+
+MICROCHAIN_EXPORT(setIrreversible) uint32_t setIrreversible(uint32_t irreversible)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      query_cache.clear();
+      if (auto* b = block_log.block_before_num(irreversible + 1))
+         block_log.irreversible = std::max(block_log.irreversible, b->num);
+      db.db.commit(block_log.irreversible);
+      return block_log.irreversible;
+   });
+}
+
+MICROCHAIN_EXPORT(trimBlocks) bool trimBlocks()
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      query_cache.clear();
+      block_log.trim();
+   });
+}
+
+MICROCHAIN_EXPORT(undoBlockNum) bool undoBlockNum(uint32_t blockNum)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      forked_n_blocks(block_log.undo(blockNum));
+   });
+}
+
+MICROCHAIN_EXPORT(undoEosioNum) bool undoEosioNum(uint32_t eosioNum)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      if (auto* b = block_log.block_by_eosio_num(eosioNum))
+         forked_n_blocks(block_log.undo(b->num));
+   });
+}
+
+// Keeps the row changes of the last num_blocks reversible blocks for
+// getBlockDeltas. 0 (the default) disables recording.
+MICROCHAIN_EXPORT(setBlockDeltaRetention) bool setBlockDeltaRetention(uint32_t num_blocks)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      block_delta_retention = num_blocks;
+      while (block_deltas.size() > block_delta_retention)
+         block_deltas.pop_front();
+   });
+}
+
+// Sets result to the row changes made by a block; see block_delta
+MICROCHAIN_EXPORT(getBlockDeltas) bool getBlockDeltas(uint32_t block_num)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      for (auto& delta : block_deltas)
       {
-         eosio::from_bin(traces, blocks_result->traces.value());
+         if (delta.num == block_num)
+         {
+            result = delta.data;
+            return true;
+         }
       }
+      return false;
+   });
+}
+
+MICROCHAIN_EXPORT(getBlock) bool getBlock(uint32_t num)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      auto block = block_log.block_by_num(num);
+      if (!block)
+         return false;
+      result = eosio::convert_to_bin(*block);
+      return true;
+   });
+}
 
-      auto prev_block = blocks_result->prev_block ? blocks_result->prev_block.value()
-                                                  : eosio::ship_protocol::block_position{};
+// Snapshot layout:
+//    snapshot_header
+//    for each table, in database::for_each_table order:
+//       type_id, next_id, row count (varuint32), rows (id, reflected fields)
+//    block log: block count (varuint32), blocks, irreversible
+//
+// Tables are saved at the irreversible revision, read from the undo stack
+// without undoing anything. Reversible blocks are replayed from the block
+// log after loading.
+constexpr uint32_t snapshot_version = 2;
+
+struct snapshot_header
+{
+   uint32_t version = snapshot_version;
+   eosio::name eden;
+   eosio::name token;
+   eosio::name atomic;
+   eosio::name atomicmarket;
+};
+EOSIO_REFLECT(snapshot_header, version, eden, token, atomic, atomicmarket)
 
-      return add_block(blocks_result->this_block.value(), prev_block,
-                       blocks_result->last_irreversible.block_num, signed_block.timestamp, traces);
+template <typename Table, typename S>
+void write_snapshot_table(const Table& table, S& stream)
+{
+   uint16_t type_id = Table::value_type::type_id;
+   eosio::to_bin(type_id, stream);
+   eosio::to_bin(table.committed_next_id()._id, stream);
+   auto rows = table.committed_rows();
+   eosio::varuint32_to_bin(rows.size(), stream);
+   for (auto* obj : rows)
+   {
+      eosio::to_bin(obj->id._id, stream);
+      eosio::to_bin(*obj, stream);
    }
-   return false;
 }
 
-[[clang::export_name("setIrreversible")]] uint32_t setIrreversible(uint32_t irreversible)
+template <typename Table>
+void read_snapshot_table(Table& table, eosio::input_stream& stream)
 {
-   if (auto* b = block_log.block_before_num(irreversible + 1))
-      block_log.irreversible = std::max(block_log.irreversible, b->num);
-   db.db.commit(block_log.irreversible);
-   return block_log.irreversible;
+   uint16_t type_id;
+   int64_t next_id;
+   eosio::from_bin(type_id, stream);
+   eosio::check(type_id == Table::value_type::type_id, "snapshot table mismatch");
+   eosio::from_bin(next_id, stream);
+   auto num_rows = eosio::varuint32_from_bin(stream);
+   table.bulk_load(num_rows, [&](auto& obj) {
+      eosio::from_bin(obj.id._id, stream);
+      eosio::from_bin(obj, stream);
+   });
+   table.set_next_id(next_id);
 }
 
-[[clang::export_name("trimBlocks")]] void trimBlocks()
+template <typename S>
+void write_snapshot(S& stream)
 {
-   block_log.trim();
+   eosio::to_bin(snapshot_header{.eden = eden_account,
+                                 .token = token_account,
+                                 .atomic = atomic_account,
+                                 .atomicmarket = atomicmarket_account},
+                 stream);
+   db.for_each_table([&](const char*, auto& table) { write_snapshot_table(table, stream); });
+   eosio::varuint32_to_bin(block_log.blocks.size(), stream);
+   for (auto& block : block_log.blocks)
+      eosio::to_bin(*block, stream);
+   eosio::to_bin(block_log.irreversible, stream);
 }
 
-[[clang::export_name("undoBlockNum")]] void undoBlockNum(uint32_t blockNum)
+void replay_reversible_blocks()
 {
-   forked_n_blocks(block_log.undo(blockNum));
+   for (auto it = block_log.upper_bound_by_num(block_log.irreversible); it != block_log.blocks.end();
+        ++it)
+   {
+      auto session = db.db.start_undo_session(true);
+      filter_block((*it)->eosioBlock);
+      session.push();
+   }
 }
 
-[[clang::export_name("undoEosioNum")]] void undoEosioNum(uint32_t eosioNum)
+MICROCHAIN_EXPORT(saveSnapshot) bool saveSnapshot()
 {
-   if (auto* b = block_log.block_by_eosio_num(eosioNum))
-      forked_n_blocks(block_log.undo(b->num));
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      eosio::size_stream ss;
+      write_snapshot(ss);
+      std::vector<char> bin(ss.size);
+      eosio::fixed_buf_stream fbs(bin.data(), bin.size());
+      write_snapshot(fbs);
+      result = std::move(bin);
+   });
 }
 
-[[clang::export_name("getBlock")]] bool getBlock(uint32_t num)
-{
-   auto block = block_log.block_by_num(num);
-   if (!block)
-      return false;
-   result = eosio::convert_to_bin(*block);
-   return true;
+// TODO: prevent from_bin from aborting
+MICROCHAIN_EXPORT(loadSnapshot) bool loadSnapshot(const char* data, uint32_t size)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      eosio::check(block_log.blocks.empty() && db.db.revision() == 0,
+                   "loadSnapshot requires an empty database");
+      query_cache.clear();
+      db.for_each_table([](const char*, auto& table) {
+         eosio::check(table.empty(), "loadSnapshot requires an empty database");
+      });
+
+      eosio::input_stream stream{data, size};
+      snapshot_header header;
+      eosio::from_bin(header, stream);
+      eosio::check(header.version == snapshot_version, "unsupported snapshot version");
+      eosio::check(header.eden == eden_account && header.token == token_account &&
+                       header.atomic == atomic_account &&
+                       header.atomicmarket == atomicmarket_account,
+                   "snapshot was created with different accounts");
+      db.for_each_table([&](const char*, auto& table) { read_snapshot_table(table, stream); });
+      for (auto& obj : db.members)
+         update_member_search(obj.member.account);
+      auto num_blocks = eosio::varuint32_from_bin(stream);
+      block_log.blocks.reserve(num_blocks);
+      for (uint32_t i = 0; i < num_blocks; ++i)
+      {
+         auto block = std::make_unique<subchain::block_with_id>();
+         eosio::from_bin(*block, stream);
+         block_log.blocks.push_back(std::move(block));
+      }
+      eosio::from_bin(block_log.irreversible, stream);
+      eosio::check(!stream.remaining(), "extra data at end of snapshot");
+
+      db.db.set_revision(block_log.irreversible);
+      replay_reversible_blocks();
+   });
 }
 
 constexpr const char MemberConnection_name[] = "MemberConnection";
@@ -2621,6 +3491,29 @@ struct Query
           [](auto& members, auto key) { return members.upper_bound(key); });
    }
 
+   // Members whose account or profile name, or a word in either, begins with
+   // text. Matching ignores case and punctuation, and only considers the
+   // first max_search_term_size bytes of text.
+   MemberConnection membersSearch(std::string text,
+                                  std::optional<uint32_t> first,
+                                  std::optional<std::string> after) const
+   {
+      auto term = normalize_search_text(text);
+      term.resize(std::min<size_t>(term.size(), max_search_term_size));
+      return clchain::make_connection<MemberConnection, MemberSearchKey>(
+          std::nullopt, MemberSearchKey{term, account_min},  //
+          std::nullopt, MemberSearchKey{term, account_max},  //
+          first, std::nullopt, std::nullopt, after,          //
+          db.member_search.get<by_pk>(),                     //
+          [](auto& obj) { return obj.by_pk(); },             //
+          [](auto& obj) {
+             auto& member = get<by_pk_hash>(db.members, obj.account).member;
+             return Member{member.account, &member};
+          },
+          [](auto& member_search, auto key) { return member_search.lower_bound(key); },
+          [](auto& member_search, auto key) { return member_search.upper_bound(key); });
+   }
+
    SessionConnection sessions(std::optional<eosio::name> gt,
                               std::optional<eosio::name> ge,
                               std::optional<eosio::name> lt,
@@ -2741,6 +3634,7 @@ EOSIO_REFLECT2(
     method(encryptionKeys, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
     method(members, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
     method(membersByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
+    method(membersSearch, "text", "first", "after"),
     method(sessions, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
     method(inductions, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
     method(inductionsByCreatedAt, "gt", "ge", "lt", "le", "first", "last", "before", "after"),
@@ -2748,20 +3642,307 @@ EOSIO_REFLECT2(
     method(distributions, "gt", "ge", "lt", "le", "first", "last", "before", "after"))
 
 auto schema = clchain::get_gql_schema<Query>();
-[[clang::export_name("getSchemaSize")]] uint32_t getSchemaSize()
+MICROCHAIN_EXPORT(getSchemaSize) uint32_t getSchemaSize()
 {
    return schema.size();
 }
-[[clang::export_name("getSchema")]] const char* getSchema()
+MICROCHAIN_EXPORT(getSchema) const char* getSchema()
 {
    return schema.c_str();
 }
 
-[[clang::export_name("query")]] void query(const char* query,
-                                           uint32_t size,
-                                           const char* variables,
-                                           uint32_t variables_size)
+// Passes the response to use(), getting it from query_cache if possible and
+// from run() otherwise
+template <typename F, typename U>
+void cached_query(std::string key, std::string_view variables, F&& run, U&& use)
+{
+   key.append(variables);
+   auto* head = block_log.head();
+   if (query_cache.get(head ? head->id : eosio::checksum256{}, key, use))
+      return;
+   auto response = run();
+   use(response);
+   query_cache.put(std::move(key), std::move(response));
+}
+
+void set_result(const std::string& response)
+{
+   result = response;
+}
+
+std::string query_cache_key(std::string_view query, bool binary = false)
+{
+   auto key = clchain::normalize_query(query);
+   key.push_back(binary);
+   return key;
+}
+
+MICROCHAIN_EXPORT(query) bool query(const char* query,
+                                    uint32_t size,
+                                    const char* variables,
+                                    uint32_t variables_size)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      cached_query(
+          query_cache_key({query, size}), {variables, variables_size},
+          [&] {
+             Query root{block_log};
+             return clchain::gql_query(root, {query, size}, {variables, variables_size});
+          },
+          set_result);
+   });
+}
+
+// Like query, but produces the binary format of clchain::gql_query_bin.
+// queryBinToJson converts the result to JSON.
+MICROCHAIN_EXPORT(queryBin) bool queryBin(const char* query,
+                                          uint32_t size,
+                                          const char* variables,
+                                          uint32_t variables_size)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      cached_query(
+          query_cache_key({query, size}, true), {variables, variables_size},
+          [&] {
+             Query root{block_log};
+             auto bin = clchain::gql_query_bin(root, *clchain::gql_prepare({query, size}),
+                                               {variables, variables_size});
+             return std::string(bin.begin(), bin.end());
+          },
+          set_result);
+   });
+}
+
+// Doesn't need the state which produced data; only the query, variables,
+// and schema must match
+MICROCHAIN_EXPORT(queryBinToJson) bool queryBinToJson(const char* query,
+                                                      uint32_t size,
+                                                      const char* variables,
+                                                      uint32_t variables_size,
+                                                      const char* data,
+                                                      uint32_t data_size)
+{
+   return guard_export([&] {
+      result = clchain::gql_bin_to_json((Query*)nullptr, *clchain::gql_prepare({query, size}),
+                                        {variables, variables_size}, {data, data_size});
+   });
+}
+
+// Runs several queries against the same state. The input is a sequence of
+// entries: query size (uint32_t), query, variables size (uint32_t),
+// variables. The result holds the number of responses (uint32_t), then the
+// offset and size (uint32_t each) of each response within the result, then
+// the responses.
+// TODO: prevent from_bin from aborting
+MICROCHAIN_EXPORT(queryBatch) uint32_t queryBatch(const char* data, uint32_t size)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      std::vector<std::pair<std::string_view, std::string_view>> queries;
+      eosio::input_stream stream{data, size};
+      auto read_string = [&] {
+         uint32_t size;
+         eosio::from_bin(size, stream);
+         stream.check_available(size);
+         std::string_view str{stream.pos, size};
+         stream.skip(size);
+         return str;
+      };
+      while (stream.remaining())
+      {
+         auto query = read_string();
+         queries.emplace_back(query, read_string());
+      }
+
+      std::vector<char> responses(sizeof(uint32_t) * (1 + 2 * queries.size()));
+      std::vector<uint32_t> offsets;
+      Query root{block_log};
+      for (auto [query, variables] : queries)
+      {
+         offsets.push_back(responses.size());
+         cached_query(
+             query_cache_key(query), variables,
+             [&] { return clchain::gql_query(root, query, variables); },
+             [&](const std::string& response) {
+                responses.insert(responses.end(), response.begin(), response.end());
+             });
+      }
+      offsets.push_back(responses.size());
+
+      eosio::fixed_buf_stream header{responses.data(), responses.size()};
+      eosio::to_bin(uint32_t(queries.size()), header);
+      for (size_t i = 0; i < queries.size(); ++i)
+      {
+         eosio::to_bin(offsets[i], header);
+         eosio::to_bin(offsets[i + 1] - offsets[i], header);
+      }
+      result = std::move(responses);
+      return queries.size();
+   });
+}
+
+struct prepared_query
 {
-   Query root{block_log};
-   result = clchain::gql_query(root, {query, size}, {variables, variables_size});
+   std::string cache_key;
+   std::unique_ptr<clchain::gql_prepared_query> query;
+};
+
+// The caller owns the result and must release it with freeQuery. Errors in
+// the query are reported by executeQuery.
+MICROCHAIN_EXPORT(prepareQuery) prepared_query* prepareQuery(const char* query, uint32_t size)
+{
+   return guard_export([&] {
+      return new prepared_query{query_cache_key({query, size}),
+                                clchain::gql_prepare({query, size})};
+   });
+}
+
+MICROCHAIN_EXPORT(executeQuery) bool executeQuery(const prepared_query* query,
+                                                  const char* variables,
+                                                  uint32_t variables_size)
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      cached_query(
+          query->cache_key, {variables, variables_size},
+          [&] {
+             Query root{block_log};
+             return clchain::gql_query(root, *query->query, {variables, variables_size});
+          },
+          set_result);
+   });
+}
+
+MICROCHAIN_EXPORT(freeQuery) void freeQuery(prepared_query* query)
+{
+   delete query;
+}
+
+// Page sizes for connections queried without first or last, and the largest
+// page a query may request. 0 means unlimited.
+MICROCHAIN_EXPORT(setConnectionLimits) bool setConnectionLimits(uint32_t default_page_size,
+                                                                uint32_t max_page_size)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      clchain::connection_page_limits = {default_page_size, max_page_size};
+      query_cache.clear();
+   });
+}
+
+// 0 disables the query cache
+MICROCHAIN_EXPORT(setQueryCacheSize) bool setQueryCacheSize(uint32_t max_bytes)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      query_cache.set_max_bytes(max_bytes);
+   });
+}
+
+MICROCHAIN_EXPORT(getQueryCacheStats) bool getQueryCacheStats()
+{
+   return guard_export([&] {
+      result = eosio::convert_to_json(query_cache.stats());
+   });
+}
+
+// Query stats are off by default. Queries answered from query_cache aren't
+// counted.
+MICROCHAIN_EXPORT(setQueryStatsEnabled) bool setQueryStatsEnabled(bool enabled)
+{
+   return guard_export([&] {
+      write_lock lock{state_mutex};
+      clchain::gql_query_stats.enabled = enabled;
+   });
+}
+
+MICROCHAIN_EXPORT(getQueryStats) bool getQueryStats()
+{
+   return guard_export([&] {
+      result = eosio::convert_to_json(clchain::gql_query_stats.report());
+   });
+}
+
+MICROCHAIN_EXPORT(clearQueryStats) bool clearQueryStats()
+{
+   return guard_export([&] {
+      clchain::gql_query_stats.clear();
+   });
+}
+
+// Byte counts are approximate: tables count node sizes only, and block_log
+// counts the serialized size of its blocks.
+struct table_memory_stats
+{
+   std::string table;
+   uint64_t rows = 0;
+   uint64_t undo_old_values = 0;
+   uint64_t undo_removed_values = 0;
+   uint64_t bytes = 0;
+};
+EOSIO_REFLECT(table_memory_stats, table, rows, undo_old_values, undo_removed_values, bytes)
+
+struct memory_stats
+{
+   std::vector<table_memory_stats> tables;
+   uint64_t table_bytes = 0;
+   int64_t undo_revision_begin = 0;
+   int64_t undo_revision_end = 0;
+   uint32_t undo_depth = 0;
+   uint32_t block_log_blocks = 0;
+   uint64_t block_log_bytes = 0;
+   uint64_t block_delta_bytes = 0;
+   uint64_t query_cache_bytes = 0;
+   uint64_t wasm_memory_bytes = 0;  // 0 in native builds
+};
+EOSIO_REFLECT(memory_stats,
+              tables,
+              table_bytes,
+              undo_revision_begin,
+              undo_revision_end,
+              undo_depth,
+              block_log_blocks,
+              block_log_bytes,
+              block_delta_bytes,
+              query_cache_bytes,
+              wasm_memory_bytes)
+
+MICROCHAIN_EXPORT(getMemoryStats) bool getMemoryStats()
+{
+   return guard_export([&] {
+      read_lock lock{state_mutex};
+      memory_stats stats;
+      auto add_table = [&](const char* name, auto& table) {
+         auto usage = table.get_memory_usage();
+         stats.tables.push_back({
+             .table = name,
+             .rows = usage.rows,
+             .undo_old_values = usage.old_values,
+             .undo_removed_values = usage.removed_values,
+             .bytes = usage.bytes,
+         });
+         stats.table_bytes += usage.bytes;
+      };
+      db.for_each_table(add_table);
+      add_table("member_search", db.member_search);
+
+      std::tie(stats.undo_revision_begin, stats.undo_revision_end) =
+          db.db.undo_stack_revision_range();
+      stats.undo_depth = stats.undo_revision_end - stats.undo_revision_begin;
+
+      stats.block_log_blocks = block_log.blocks.size();
+      eosio::size_stream ss;
+      for (auto& block : block_log.blocks)
+         eosio::to_bin(*block, ss);
+      stats.block_log_bytes = ss.size;
+      for (auto& delta : block_deltas)
+         stats.block_delta_bytes += delta.data.size();
+      stats.query_cache_bytes = query_cache.stats().bytes;
+#ifdef __wasm__
+      stats.wasm_memory_bytes = uint64_t(__builtin_wasm_memory_size(0)) * 65536;
+#endif
+      result = eosio::convert_to_json(stats);
+   });
 }
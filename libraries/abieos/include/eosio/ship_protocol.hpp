@@ -402,6 +402,213 @@ namespace eosio
          return to_json(obj.recurse, stream);
       }
 
+      // skip_bin advances a stream past a serialized T without constructing it.
+      // Types without a dedicated overload fall back to from_bin.
+      template <typename T, typename S>
+      void skip_bin(T*, S& stream);
+      template <typename T, std::size_t N, typename S>
+      void skip_bin(std::array<T, N>*, S& stream);
+      template <typename T, typename S>
+      void skip_bin(std::vector<T>*, S& stream);
+      template <typename T, typename S>
+      void skip_bin(std::optional<T>*, S& stream);
+      template <typename... Ts, typename S>
+      void skip_bin(std::variant<Ts...>*, S& stream);
+      template <typename S>
+      void skip_bin(std::string*, S& stream);
+      template <typename S>
+      void skip_bin(eosio::input_stream*, S& stream);
+      template <typename S>
+      void skip_bin(eosio::varuint32*, S& stream);
+      template <typename T, std::size_t Size, typename S>
+      void skip_bin(eosio::fixed_bytes<Size, T>*, S& stream);
+      template <typename S>
+      void skip_bin(recurse_transaction_trace*, S& stream);
+
+      template <typename T, typename S>
+      void skip_bin(T*, S& stream)
+      {
+         if constexpr (has_bitwise_serialization<T>())
+            stream.skip(sizeof(T));
+         else if constexpr (reflection::has_for_each_field_v<T>)
+            eosio_for_each_field((T*)nullptr, [&](const char*, auto member, auto...) {
+               if constexpr (std::is_member_object_pointer_v<decltype(member((T*)nullptr))>)
+               {
+                  using M = std::remove_cvref_t<decltype(std::declval<T&>().*member((T*)nullptr))>;
+                  skip_bin((M*)nullptr, stream);
+               }
+            });
+         else
+         {
+            T obj;
+            from_bin(obj, stream);
+         }
+      }
+
+      template <typename T, std::size_t N, typename S>
+      void skip_bin(std::array<T, N>*, S& stream)
+      {
+         if constexpr (has_bitwise_serialization<T>())
+            stream.skip(N * sizeof(T));
+         else
+            for (std::size_t i = 0; i < N; ++i)
+               skip_bin((T*)nullptr, stream);
+      }
+
+      template <typename T, typename S>
+      void skip_bin(std::vector<T>*, S& stream)
+      {
+         auto size = varuint32_from_bin(stream);
+         if constexpr (has_bitwise_serialization<T>())
+            stream.skip(size * sizeof(T));
+         else
+            for (uint32_t i = 0; i < size; ++i)
+               skip_bin((T*)nullptr, stream);
+      }
+
+      template <typename T, typename S>
+      void skip_bin(std::optional<T>*, S& stream)
+      {
+         bool present;
+         from_bin(present, stream);
+         if (present)
+            skip_bin((T*)nullptr, stream);
+      }
+
+      template <typename... Ts, typename S>
+      void skip_bin(std::variant<Ts...>*, S& stream)
+      {
+         auto index = varuint32_from_bin(stream);
+         if (index >= sizeof...(Ts))
+            report_error("invalid variant index");
+         uint32_t i = 0;
+         ((i++ == index ? skip_bin((Ts*)nullptr, stream) : void()), ...);
+      }
+
+      template <typename S>
+      void skip_bin(std::string*, S& stream)
+      {
+         stream.skip(varuint32_from_bin(stream));
+      }
+
+      template <typename S>
+      void skip_bin(eosio::input_stream*, S& stream)
+      {
+         stream.skip(varuint32_from_bin(stream));
+      }
+
+      template <typename S>
+      void skip_bin(eosio::varuint32*, S& stream)
+      {
+         varuint32_from_bin(stream);
+      }
+
+      template <typename T, std::size_t Size, typename S>
+      void skip_bin(eosio::fixed_bytes<Size, T>*, S& stream)
+      {
+         stream.skip(Size);
+      }
+
+      template <typename S>
+      void skip_bin(recurse_transaction_trace*, S& stream)
+      {
+         skip_bin((transaction_trace*)nullptr, stream);
+      }
+
+      // The parts of an action_trace which are decoded by
+      // for_each_transaction_trace. data refers to the original buffer.
+      struct action_trace_view
+      {
+         uint32_t creator_action_ordinal = 0;
+         std::optional<uint64_t> global_sequence;
+         eosio::name receiver;
+         eosio::name account;
+         eosio::name name;
+         eosio::input_stream data;
+      };
+
+      template <typename S>
+      void action_trace_view_from_bin(action_trace_view& obj, S& stream)
+      {
+         auto version = varuint32_from_bin(stream);
+         if (version > 1)
+            report_error("invalid action_trace version");
+         skip_bin((varuint32*)nullptr, stream);  // action_ordinal
+         obj.creator_action_ordinal = varuint32_from_bin(stream);
+         obj.global_sequence.reset();
+         bool has_receipt;
+         from_bin(has_receipt, stream);
+         if (has_receipt)
+         {
+            if (varuint32_from_bin(stream) != 0)
+               report_error("invalid action_receipt version");
+            skip_bin((eosio::name*)nullptr, stream);         // receiver
+            skip_bin((eosio::checksum256*)nullptr, stream);  // act_digest
+            from_bin(obj.global_sequence.emplace(), stream);
+            skip_bin((uint64_t*)nullptr, stream);  // recv_sequence
+            skip_bin((std::vector<account_auth_sequence>*)nullptr, stream);
+            skip_bin((varuint32*)nullptr, stream);  // code_sequence
+            skip_bin((varuint32*)nullptr, stream);  // abi_sequence
+         }
+         from_bin(obj.receiver, stream);
+         from_bin(obj.account, stream);
+         from_bin(obj.name, stream);
+         skip_bin((std::vector<permission_level>*)nullptr, stream);
+         from_bin(obj.data, stream);
+         skip_bin((bool*)nullptr, stream);     // context_free
+         skip_bin((int64_t*)nullptr, stream);  // elapsed
+         skip_bin((std::string*)nullptr, stream);
+         skip_bin((std::vector<account_delta>*)nullptr, stream);
+         skip_bin((std::optional<std::string>*)nullptr, stream);
+         skip_bin((std::optional<uint64_t>*)nullptr, stream);
+         if (version == 1)
+            skip_bin((eosio::input_stream*)nullptr, stream);  // return_value
+      }
+
+      // Walks a serialized std::vector<transaction_trace> without building
+      // it, calling f(id, action_traces) for each transaction. action_traces
+      // is indexed by action_ordinal - 1; its storage is reused across
+      // transactions, so callers can keep it around to avoid allocating.
+      template <typename F>
+      void for_each_transaction_trace(eosio::input_stream traces,
+                                      std::vector<action_trace_view>& action_traces,
+                                      F&& f)
+      {
+         auto num_traces = varuint32_from_bin(traces);
+         for (uint32_t i = 0; i < num_traces; ++i)
+         {
+            if (varuint32_from_bin(traces) != 0)
+               report_error("invalid transaction_trace version");
+            eosio::checksum256 id;
+            from_bin(id, traces);
+            skip_bin((transaction_status*)nullptr, traces);
+            skip_bin((uint32_t*)nullptr, traces);  // cpu_usage_us
+            skip_bin((varuint32*)nullptr, traces);  // net_usage_words
+            skip_bin((int64_t*)nullptr, traces);    // elapsed
+            skip_bin((uint64_t*)nullptr, traces);   // net_usage
+            skip_bin((bool*)nullptr, traces);       // scheduled
+            auto num_actions = varuint32_from_bin(traces);
+            action_traces.resize(num_actions);
+            for (auto& action_trace : action_traces)
+               action_trace_view_from_bin(action_trace, traces);
+            skip_bin((std::optional<account_delta>*)nullptr, traces);
+            skip_bin((std::optional<std::string>*)nullptr, traces);
+            skip_bin((std::optional<uint64_t>*)nullptr, traces);
+            skip_bin((std::vector<recurse_transaction_trace>*)nullptr, traces);
+            skip_bin((std::optional<partial_transaction>*)nullptr, traces);
+            f(id, action_traces);
+         }
+      }
+
+      // Decodes the timestamp at the start of a serialized signed_block
+      // without decoding the rest of the block.
+      inline eosio::block_timestamp get_block_timestamp(eosio::input_stream block)
+      {
+         eosio::block_timestamp timestamp;
+         from_bin(timestamp, block);
+         return timestamp;
+      }
+
       struct producer_key
       {
          eosio::name producer_name = {};
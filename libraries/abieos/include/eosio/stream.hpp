@@ -144,6 +144,26 @@ namespace eosio
       }
    };
 
+   // Feeds the written bytes to a hasher instead of storing them. H needs
+   // update(const char* data, size_t size).
+   template <typename H>
+   struct hash_stream
+   {
+      H& hasher;
+      hash_stream(H& hasher) : hasher(hasher) {}
+
+      void write(char c) { hasher.update(&c, 1); }
+      void write(const void* src, std::size_t sz)
+      {
+         hasher.update(reinterpret_cast<const char*>(src), sz);
+      }
+      template <typename T>
+      void write_raw(const T& v)
+      {
+         write(&v, sizeof(v));
+      }
+   };
+
    struct size_stream
    {
       size_t size = 0;
@@ -1,10 +1,17 @@
 #pragma once
 
+#include <chainbase/pool_allocator.hpp>
 #include <chainbase/undo_index.hpp>
 
 #include <boost/core/demangle.hpp>
 #include <boost/multi_index_container.hpp>
 
+#ifndef __wasm__
+#include <boost/interprocess/allocators/allocator.hpp>
+#include <boost/interprocess/managed_mapped_file.hpp>
+#include <filesystem>
+#endif
+
 #include <iostream>
 #include <set>
 #include <sstream>
@@ -18,10 +25,20 @@ namespace chainbase
    using std::vector;
 
    template <typename T>
-   using allocator = std::allocator<T>;
+   using allocator = pool_allocator<T>;
 
    template <typename T>
-   using node_allocator = std::allocator<T>;
+   using node_allocator = pool_allocator<T>;
+
+#ifndef __wasm__
+   using segment_manager = boost::interprocess::managed_mapped_file::segment_manager;
+
+   // Allocates from a database's mapped file. Objects in a mapped index must
+   // not own heap memory (e.g. std::string); they are reloaded from the file
+   // by later processes, possibly at a different address.
+   template <typename T>
+   using mapped_allocator = boost::interprocess::allocator<T, segment_manager>;
+#endif
 
    /**
     *  Object ID type that includes the type of the object it references
@@ -195,6 +212,73 @@ namespace chainbase
          _index_map.clear();
       }
 
+#ifndef __wasm__
+      // Opens a database whose indices live in a memory-mapped file, creating
+      // the file if needed. The file grows to size bytes if it's smaller. Only
+      // indices added with add_mapped_index are stored in the file.
+      //
+      // The file is marked dirty until the database is destroyed, so opening a
+      // file which wasn't closed cleanly fails unless allow_dirty is set. A
+      // dirty file may hold a half-applied change, even with undo sessions
+      // open, so the usual recovery is to delete it and restore from a
+      // snapshot. allow_dirty is for files known to be consistent, e.g. when
+      // the process stopped between blocks, or for inspecting a damaged file.
+      database(const std::filesystem::path& path, std::size_t size, bool allow_dirty = false)
+      {
+         namespace bip = boost::interprocess;
+         auto mapped = std::make_unique<mapped_file>();
+         if (std::filesystem::exists(path))
+         {
+            auto existing = std::filesystem::file_size(path);
+            if (size > existing)
+               bip::managed_mapped_file::grow(path.c_str(), size - existing);
+            mapped->segment = bip::managed_mapped_file(bip::open_only, path.c_str());
+         }
+         else
+         {
+            mapped->segment = bip::managed_mapped_file(bip::create_only, path.c_str(), size);
+         }
+         auto* header = mapped->segment.find_or_construct<mapped_header>("chainbase_header")();
+         if (header->dirty && !allow_dirty)
+            eosio::check(false, "database dirty flag set (likely due to unclean shutdown)");
+         header->dirty = true;
+         mapped->segment.flush();
+         mapped->header = header;
+         _mapped = std::move(mapped);
+      }
+
+      // Finds or creates the index in the mapped file and registers it. Fails
+      // if the stored index doesn't have the layout this executable expects.
+      template <typename MultiIndexType>
+      generic_index<MultiIndexType>& add_mapped_index()
+      {
+         using index_type = generic_index<MultiIndexType>;
+         if (!_mapped)
+            eosio::check(false, "add_mapped_index requires a mapped database");
+         auto& segment = _mapped->segment;
+         std::string type_name =
+             boost::core::demangle(typeid(typename index_type::value_type).name());
+         auto* idx = segment.find_or_construct<index_type>(type_name.c_str())(
+             typename index_type::allocator_type(segment.get_segment_manager()));
+         idx->validate();
+         add_index(*idx);
+         return *idx;
+      }
+
+      // Writes modified pages to the file
+      void flush()
+      {
+         if (_mapped)
+            _mapped->segment.flush();
+      }
+
+      // Bytes not yet allocated in the mapped file
+      std::size_t free_memory() const
+      {
+         return _mapped ? _mapped->segment.get_free_memory() : 0;
+      }
+#endif
+
       struct session
       {
         public:
@@ -441,9 +525,40 @@ namespace chainbase
        * This is a full map (size 2^16) of all possible index designed for constant time lookup
        */
       vector<unique_ptr<abstract_index>> _index_map;
+
+#ifndef __wasm__
+      struct mapped_header
+      {
+         bool dirty = false;
+      };
+
+      // Clears the dirty flag when the file is closed, if it was opened cleanly
+      struct mapped_file
+      {
+         boost::interprocess::managed_mapped_file segment;
+         mapped_header* header = nullptr;
+
+         ~mapped_file()
+         {
+            if (!header)
+               return;
+            segment.flush();
+            header->dirty = false;
+            segment.flush();
+         }
+      };
+
+      unique_ptr<mapped_file> _mapped;
+#endif
    };
 
    template <typename Object, typename... Args>
    using shared_multi_index_container =
        boost::multi_index_container<Object, Args..., chainbase::node_allocator<Object>>;
+
+#ifndef __wasm__
+   template <typename Object, typename... Args>
+   using mapped_multi_index_container =
+       boost::multi_index_container<Object, Args..., chainbase::mapped_allocator<Object>>;
+#endif
 }  // namespace chainbase
@@ -0,0 +1,191 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace chainbase
+{
+   // Hands out fixed-size blocks carved from large slabs. Freed blocks go on a
+   // free list and are reused by later allocations. When the last block is
+   // freed, all slabs but one are returned to the system. Not thread-safe.
+   class slab_pool
+   {
+     public:
+      explicit slab_pool(std::size_t block_size)
+          : block_size(block_size),
+            slab_size(std::max<std::size_t>(64 * 1024 / block_size, 16) * block_size)
+      {
+      }
+      slab_pool(const slab_pool&) = delete;
+      slab_pool& operator=(const slab_pool&) = delete;
+      ~slab_pool()
+      {
+         for (auto slab : slabs)
+            ::operator delete(slab);
+      }
+
+      void* allocate()
+      {
+         if (free_list)
+         {
+            auto p = free_list;
+            free_list = *static_cast<void**>(p);
+            ++live;
+            return p;
+         }
+         if (next == end)
+         {
+            slabs.reserve(slabs.size() + 1);
+            next = static_cast<char*>(::operator new(slab_size));
+            end = next + slab_size;
+            slabs.push_back(next);
+         }
+         auto p = next;
+         next += block_size;
+         ++live;
+         return p;
+      }
+
+      void deallocate(void* p) noexcept
+      {
+         *static_cast<void**>(p) = free_list;
+         free_list = p;
+         if (--live == 0)
+            trim();
+      }
+
+      std::size_t get_block_size() const { return block_size; }
+      std::size_t blocks_in_use() const { return live; }
+      std::size_t reserved_bytes() const { return slabs.size() * slab_size; }
+
+     private:
+      // Keeps the newest slab so that a table which repeatedly empties and
+      // refills doesn't allocate a slab each time
+      void trim() noexcept
+      {
+         if (slabs.empty())
+            return;
+         for (std::size_t i = 0; i + 1 < slabs.size(); ++i)
+            ::operator delete(slabs[i]);
+         slabs.erase(slabs.begin(), slabs.end() - 1);
+         free_list = nullptr;
+         next = slabs.back();
+         end = next + slab_size;
+      }
+
+      const std::size_t block_size;
+      const std::size_t slab_size;
+      std::vector<char*> slabs;
+      void* free_list = nullptr;
+      char* next = nullptr;
+      char* end = nullptr;
+      std::size_t live = 0;
+   };
+
+   // The pools shared by an allocator and all copies and rebinds of it, one
+   // per block size.
+   class pool_resource
+   {
+     public:
+      slab_pool& get_pool(std::size_t size, std::size_t align)
+      {
+         align = std::max(align, alignof(void*));
+         auto block_size = (std::max(size, sizeof(void*)) + align - 1) / align * align;
+         for (auto& pool : pools)
+            if (pool->get_block_size() == block_size)
+               return *pool;
+         pools.reserve(pools.size() + 1);
+         pools.push_back(std::make_unique<slab_pool>(block_size));
+         return *pools.back();
+      }
+
+      std::size_t blocks_in_use() const
+      {
+         std::size_t result = 0;
+         for (auto& pool : pools)
+            result += pool->blocks_in_use();
+         return result;
+      }
+
+      std::size_t reserved_bytes() const
+      {
+         std::size_t result = 0;
+         for (auto& pool : pools)
+            result += pool->reserved_bytes();
+         return result;
+      }
+
+     private:
+      std::vector<std::unique_ptr<slab_pool>> pools;
+   };
+
+   // Allocates single objects from slab pools. A default-constructed
+   // allocator gets a new pool_resource, which its copies and rebinds share;
+   // undo_index rebinds its allocator for node and old_node, so each index
+   // recycles nodes released by undo, squash, or commit within its own
+   // pools, and the pools are freed with the index. Array allocations (e.g.
+   // the undo stack) use std::allocator.
+   //
+   // Like undo_index itself, callers must serialize modifications of an
+   // index. Separate indices don't share pools, so they may be modified by
+   // different threads.
+   template <typename T>
+   class pool_allocator
+   {
+     public:
+      using value_type = T;
+
+      pool_allocator() : resource(std::make_shared<pool_resource>()), pool(&get_pool(*resource))
+      {
+      }
+      pool_allocator(const pool_allocator&) = default;
+      template <typename U>
+      pool_allocator(const pool_allocator<U>& other)
+          : resource(other.resource), pool(&get_pool(*resource))
+      {
+      }
+      pool_allocator& operator=(const pool_allocator&) = default;
+
+      T* allocate(std::size_t n)
+      {
+         if (n != 1)
+            return std::allocator<T>{}.allocate(n);
+         return static_cast<T*>(pool->allocate());
+      }
+
+      void deallocate(T* p, std::size_t n) noexcept
+      {
+         if (n != 1)
+            return std::allocator<T>{}.deallocate(p, n);
+         pool->deallocate(p);
+      }
+
+      const pool_resource& get_resource() const { return *resource; }
+
+      friend bool operator==(const pool_allocator& a, const pool_allocator& b)
+      {
+         return a.resource == b.resource;
+      }
+      friend bool operator!=(const pool_allocator& a, const pool_allocator& b)
+      {
+         return a.resource != b.resource;
+      }
+
+     private:
+      template <typename U>
+      friend class pool_allocator;
+
+      static slab_pool& get_pool(pool_resource& r)
+      {
+         static_assert(alignof(T) <= __STDCPP_DEFAULT_NEW_ALIGNMENT__,
+                       "over-aligned types not supported");
+         return r.get_pool(sizeof(T), alignof(T));
+      }
+
+      std::shared_ptr<pool_resource> resource;
+      slab_pool* pool;
+   };
+}  // namespace chainbase
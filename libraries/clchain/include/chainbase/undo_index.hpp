@@ -8,13 +8,18 @@
 #include <boost/intrusive/slist.hpp>
 #include <boost/mp11/algorithm.hpp>
 #include <boost/mp11/list.hpp>
+#include <boost/multi_index/hashed_index_fwd.hpp>
+#include <boost/multi_index/ordered_index_fwd.hpp>
 #include <boost/multi_index_container_fwd.hpp>
 #include <eosio/check.hpp>
 
+#include <algorithm>
 #include <cassert>
+#include <iterator>
 #include <memory>
 #include <sstream>
 #include <type_traits>
+#include <vector>
 
 namespace chainbase
 {
@@ -37,6 +42,17 @@ namespace chainbase
       bool _canceled = false;
    };
 
+   template <typename Iter>
+   struct iterator_range
+   {
+      Iter first;
+      Iter last;
+
+      Iter begin() const { return first; }
+      Iter end() const { return last; }
+      bool empty() const { return first == last; }
+   };
+
    // Adapts multi_index's idea of keys to intrusive
    template <typename KeyExtractor, typename T>
    struct get_key
@@ -183,18 +199,83 @@ namespace chainbase
    template <typename K, typename Allocator>
    using hook = offset_node_base<K>;
 
+   // Orders values by the index's key, then by id. Lookups by key alone
+   // ignore the id, so they see every value with that key.
    template <typename Node, typename OrderedIndex>
-   using set_base = boost::intrusive::avltree<
-       typename Node::value_type,
-       boost::intrusive::value_traits<offset_node_value_traits<Node, OrderedIndex>>,
-       boost::intrusive::key_of_value<
-           get_key<typename OrderedIndex::key_from_value_type, typename Node::value_type>>,
-       boost::intrusive::compare<typename OrderedIndex::compare_type>>;
-
-   template <typename OrderedIndex>
-   constexpr bool is_valid_index = false;
+   struct non_unique_compare
+   {
+      using value_type = typename Node::value_type;
+      using key_of_value =
+          get_key<typename OrderedIndex::key_from_value_type, typename Node::value_type>;
+      using compare = typename OrderedIndex::compare_type;
+
+      bool operator()(const value_type& a, const value_type& b) const
+      {
+         decltype(auto) ka = key_of_value{}(a);
+         decltype(auto) kb = key_of_value{}(b);
+         if (compare{}(ka, kb))
+            return true;
+         if (compare{}(kb, ka))
+            return false;
+         return a.id < b.id;
+      }
+      template <typename K>
+      bool operator()(const K& a, const value_type& b) const
+      {
+         return compare{}(a, key_of_value{}(b));
+      }
+      template <typename K>
+      bool operator()(const value_type& a, const K& b) const
+      {
+         return compare{}(key_of_value{}(a), b);
+      }
+   };
+
+   template <typename Node, typename OrderedIndex>
+   struct set_base_impl
+   {
+      using type = boost::intrusive::avltree<
+          typename Node::value_type,
+          boost::intrusive::value_traits<offset_node_value_traits<Node, OrderedIndex>>,
+          boost::intrusive::key_of_value<
+              get_key<typename OrderedIndex::key_from_value_type, typename Node::value_type>>,
+          boost::intrusive::compare<typename OrderedIndex::compare_type>>;
+   };
+
+   // Every value has a distinct position, so the tree can treat the index as
+   // unique, and the fixup in undo_index::post_modify works unchanged.
+   template <typename Node, typename... T>
+   struct set_base_impl<Node, boost::multi_index::ordered_non_unique<T...>>
+   {
+      using index_type = boost::multi_index::ordered_non_unique<T...>;
+      using type = boost::intrusive::avltree<
+          typename Node::value_type,
+          boost::intrusive::value_traits<offset_node_value_traits<Node, index_type>>,
+          boost::intrusive::compare<non_unique_compare<Node, index_type>>>;
+   };
+
+   template <typename Node, typename OrderedIndex>
+   using set_base = typename set_base_impl<Node, OrderedIndex>::type;
+
+   template <typename Index>
+   constexpr bool is_ordered_index = false;
+   template <typename... T>
+   constexpr bool is_ordered_index<boost::multi_index::ordered_unique<T...>> = true;
+
+   template <typename Index>
+   constexpr bool is_ordered_non_unique_index = false;
    template <typename... T>
-   constexpr bool is_valid_index<boost::multi_index::ordered_unique<T...>> = true;
+   constexpr bool is_ordered_non_unique_index<boost::multi_index::ordered_non_unique<T...>> =
+       true;
+
+   template <typename Index>
+   constexpr bool is_hashed_index = false;
+   template <typename... T>
+   constexpr bool is_hashed_index<boost::multi_index::hashed_unique<T...>> = true;
+
+   template <typename Index>
+   constexpr bool is_valid_index =
+       is_ordered_index<Index> || is_ordered_non_unique_index<Index> || is_hashed_index<Index>;
 
    template <typename Node, typename Tag>
    using list_base =
@@ -260,6 +341,260 @@ namespace chainbase
       friend class undo_index;
    };
 
+   // Intrusive hash table for hashed_unique indices. Each bucket is a doubly
+   // linked list threaded through the node's hook for this index. The hook's
+   // _parent field holds the element's hash, so a node can be unlinked after
+   // its key has been modified. The bucket array only grows; since undo never
+   // restores more elements than were present before, it never allocates.
+   template <typename Node, typename HashedIndex>
+   class hashed_set_impl
+   {
+      using value_traits = offset_node_value_traits<Node, HashedIndex>;
+      using node_traits = offset_node_traits<HashedIndex>;
+      using node_ptr = typename node_traits::node_ptr;
+      using key_of_value =
+          get_key<typename HashedIndex::key_from_value_type, typename Node::value_type>;
+      using hasher = typename HashedIndex::hash_type;
+      using key_equal = typename HashedIndex::pred_type;
+
+     public:
+      using value_type = typename Node::value_type;
+      using key_type = typename key_of_value::type;
+
+      class const_iterator
+      {
+        public:
+         using iterator_category = std::forward_iterator_tag;
+         using value_type = typename Node::value_type;
+         using difference_type = std::ptrdiff_t;
+         using pointer = const value_type*;
+         using reference = const value_type&;
+
+         const_iterator() = default;
+         reference operator*() const { return *value_traits::to_value_ptr(_node); }
+         pointer operator->() const { return value_traits::to_value_ptr(_node); }
+         const_iterator& operator++()
+         {
+            _node = node_traits::get_next(_node);
+            if (!_node)
+               _node = _set->first_node(_bucket + 1, _bucket);
+            return *this;
+         }
+         const_iterator operator++(int)
+         {
+            auto result = *this;
+            ++*this;
+            return result;
+         }
+         friend bool operator==(const const_iterator& a, const const_iterator& b)
+         {
+            return a._node == b._node;
+         }
+         friend bool operator!=(const const_iterator& a, const const_iterator& b)
+         {
+            return a._node != b._node;
+         }
+
+        private:
+         friend class hashed_set_impl;
+         const_iterator(const hashed_set_impl* set, std::size_t bucket, node_ptr node)
+             : _set(set), _bucket(bucket), _node(node)
+         {
+         }
+         const hashed_set_impl* _set = nullptr;
+         std::size_t _bucket = 0;
+         node_ptr _node = nullptr;
+      };
+      using iterator = const_iterator;
+
+      hashed_set_impl() = default;
+      hashed_set_impl(const hashed_set_impl&) = delete;
+      hashed_set_impl& operator=(const hashed_set_impl&) = delete;
+
+      std::size_t size() const { return _size; }
+      bool empty() const { return _size == 0; }
+
+      const_iterator begin() const
+      {
+         std::size_t bucket = 0;
+         auto node = first_node(0, bucket);
+         return {this, bucket, node};
+      }
+      const_iterator end() const { return {}; }
+
+      template <typename K>
+      const_iterator find(const K& key) const
+      {
+         return find_hashed(key, hasher{}(key));
+      }
+
+      template <typename K>
+      std::size_t count(const K& key) const
+      {
+         return find(key) != end();
+      }
+
+      const_iterator iterator_to(const value_type& value) const
+      {
+         auto node = const_cast<node_ptr>(value_traits::to_node_ptr(value));
+         return {this, bucket_of(get_hash(node)), node};
+      }
+
+     private:
+      template <typename T, typename Allocator, typename... Indices>
+      friend class undo_index;
+
+      std::pair<const_iterator, bool> insert_unique(value_type& value)
+      {
+         auto hash = hasher{}(key_of_value{}(value));
+         auto existing = find_hashed(key_of_value{}(value), hash);
+         if (existing != end())
+            return {existing, false};
+         reserve(_size + 1);
+         link(value, hash);
+         return {iterator_to(value), true};
+      }
+
+      void insert_equal(value_type& value)
+      {
+         reserve(_size + 1);
+         link(value, hasher{}(key_of_value{}(value)));
+      }
+
+      void erase(const_iterator it) noexcept { unlink(it._node); }
+
+      void clear() noexcept
+      {
+         std::fill(_buckets.get(), _buckets.get() + _bucket_count, nullptr);
+         _size = 0;
+      }
+
+      // Moves a modified node to the bucket for its new key. If unique is set and
+      // the key conflicts with another node, returns false; the node remains
+      // linked, and will be fixed when the original key is restored.
+      template <bool unique>
+      bool relink(value_type& value) noexcept
+      {
+         auto node = value_traits::to_node_ptr(value);
+         auto hash = hasher{}(key_of_value{}(value));
+         if (hash != get_hash(node))
+         {
+            unlink(node);
+            bool conflict = unique && find_hashed(key_of_value{}(value), hash) != end();
+            link(value, hash);
+            return !conflict;
+         }
+         if constexpr (unique)
+         {
+            for (auto other = _buckets[bucket_of(hash)]; other;
+                 other = node_traits::get_next(other))
+               if (other != node && get_hash(other) == hash &&
+                   key_equal{}(key_of_value{}(*value_traits::to_value_ptr(other)),
+                               key_of_value{}(value)))
+                  return false;
+         }
+         return true;
+      }
+
+      template <typename K>
+      const_iterator find_hashed(const K& key, std::size_t hash) const
+      {
+         if (!_bucket_count)
+            return end();
+         auto bucket = bucket_of(hash);
+         for (auto node = _buckets[bucket]; node; node = node_traits::get_next(node))
+            if (get_hash(node) == hash &&
+                key_equal{}(key_of_value{}(*value_traits::to_value_ptr(node)), key))
+               return {this, bucket, node};
+         return end();
+      }
+
+      // Returns the first node in a bucket at or after from, or nullptr
+      node_ptr first_node(std::size_t from, std::size_t& bucket) const
+      {
+         for (bucket = from; bucket < _bucket_count; ++bucket)
+            if (_buckets[bucket])
+               return _buckets[bucket];
+         return nullptr;
+      }
+
+      // Fibonacci hashing spreads weak hashes (e.g. identity) across the buckets
+      std::size_t bucket_of(std::size_t hash) const
+      {
+         return (uint64_t(hash) * 0x9E3779B97F4A7C15ull) >> (64 - _bucket_bits);
+      }
+
+      static std::size_t get_hash(node_ptr node) { return std::size_t(node->_parent); }
+      static void set_hash(node_ptr node, std::size_t hash) { node->_parent = hash; }
+
+      void link(value_type& value, std::size_t hash) noexcept
+      {
+         auto node = value_traits::to_node_ptr(value);
+         set_hash(node, hash);
+         auto& head = _buckets[bucket_of(hash)];
+         node_traits::set_previous(node, nullptr);
+         node_traits::set_next(node, head);
+         if (head)
+            node_traits::set_previous(head, node);
+         head = node;
+         ++_size;
+      }
+
+      void unlink(node_ptr node) noexcept
+      {
+         auto prev = node_traits::get_previous(node);
+         auto next = node_traits::get_next(node);
+         if (prev)
+            node_traits::set_next(prev, next);
+         else
+            _buckets[bucket_of(get_hash(node))] = next;
+         if (next)
+            node_traits::set_previous(next, prev);
+         --_size;
+      }
+
+      // Exception safety: strong
+      void reserve(std::size_t n)
+      {
+         if (n <= _bucket_count)
+            return;
+         int bits = std::max(_bucket_bits + 1, 4);
+         std::unique_ptr<node_ptr[]> buckets{new node_ptr[std::size_t(1) << bits]()};
+         std::swap(_buckets, buckets);
+         auto old_count = _bucket_count;
+         _bucket_bits = bits;
+         _bucket_count = std::size_t(1) << bits;
+         _size = 0;
+         for (std::size_t i = 0; i < old_count; ++i)
+         {
+            for (auto node = buckets[i]; node;)
+            {
+               auto next = node_traits::get_next(node);
+               link(*value_traits::to_value_ptr(node), get_hash(node));
+               node = next;
+            }
+         }
+      }
+
+      std::unique_ptr<node_ptr[]> _buckets;
+      std::size_t _bucket_count = 0;
+      int _bucket_bits = 0;
+      std::size_t _size = 0;
+   };
+
+   template <typename Node, typename Index>
+   struct index_set_impl
+   {
+      using type = set_impl<Node, Index>;
+   };
+   template <typename Node, typename... T>
+   struct index_set_impl<Node, boost::multi_index::hashed_unique<T...>>
+   {
+      using type = hashed_set_impl<Node, boost::multi_index::hashed_unique<T...>>;
+   };
+   template <typename Node, typename Index>
+   using index_set = typename index_set_impl<Node, Index>::type;
+
    template <typename T, typename S>
    class chainbase_node_allocator;
 
@@ -291,7 +626,9 @@ namespace chainbase
    }
 
    // Similar to boost::multi_index_container with an undo stack.
-   // Indices should be instances of ordered_unique.
+   // Indices should be instances of ordered_unique, ordered_non_unique, or
+   // hashed_unique. The first index must be an ordered_unique on id. Values
+   // with equal keys in an ordered_non_unique index are ordered by id.
    template <typename T, typename Allocator, typename... Indices>
    class undo_index
    {
@@ -300,9 +637,11 @@ namespace chainbase
       using value_type = T;
       using allocator_type = Allocator;
 
-      static_assert((... && is_valid_index<Indices>), "Only ordered_unique indices are supported");
+      static_assert((... && is_valid_index<Indices>),
+                    "Only ordered_unique, ordered_non_unique, and hashed_unique indices are "
+                    "supported");
 
-      undo_index() = default;
+      undo_index() : undo_index(Allocator{}) {}
       explicit undo_index(const Allocator& a)
           : _undo_stack{a}, _allocator{a}, _old_values_allocator{a}
       {
@@ -333,15 +672,19 @@ namespace chainbase
       };
       static constexpr int erased_flag = 2;  // 0,1,and -1 are used by the tree
 
-      using indices_type = std::tuple<set_impl<node, Indices>...>;
+      using indices_type = std::tuple<index_set<node, Indices>...>;
 
       using index0_set_type = std::tuple_element_t<0, indices_type>;
       using alloc_traits = typename std::allocator_traits<Allocator>::template rebind_traits<node>;
+      static_assert(std::is_pointer_v<typename alloc_traits::pointer> ||
+                        !(... || is_hashed_index<Indices>),
+                    "hashed_unique indices hold raw pointers, so can't be stored in a mapped file");
 
       static_assert(std::is_same_v<typename index0_set_type::key_type, id_type>,
                     "first index must be id");
 
       using index0_type = boost::mp11::mp_first<boost::mp11::mp_list<Indices...>>;
+      static_assert(is_ordered_index<index0_type>, "first index must be ordered_unique");
       struct old_node : hook<index0_type, Allocator>, value_holder<T>
       {
          using value_type = T;
@@ -436,6 +779,49 @@ namespace chainbase
          return p->_item;
       }
 
+      // Fills an empty undo_index which has no undo stack, e.g. when restoring
+      // a snapshot. c is called count times to construct the rows, and must set
+      // each row's id; ids must be unique and at least next_id(). Each ordered
+      // index is built by sorting the rows' keys (skipped if they are already in
+      // order) and appending the rows, which needs no tree searches, so input
+      // sorted by id builds the id index in linear time. next_id() becomes one
+      // past the largest id.
+      //
+      // Exception safety: strong
+      template <typename Constructor>
+      void bulk_load(std::size_t count, Constructor&& c)
+      {
+         if (!empty() || !_undo_stack.empty())
+            eosio::check(false, "bulk_load requires an empty undo_index with no undo stack");
+         std::vector<value_type*> values;
+         values.reserve(count);
+         auto guard0 = scope_exit{[&] {
+            clear_impl();
+            for (auto* v : values)
+               dispose_node(*v);
+         }};
+         for (std::size_t i = 0; i < count; ++i)
+         {
+            auto p = alloc_traits::allocate(_allocator, 1);
+            auto guard1 = scope_exit{[&] { alloc_traits::deallocate(_allocator, p, 1); }};
+            alloc_traits::construct(_allocator, &*p, c, propagate_allocator(_allocator));
+            guard1.cancel();
+            values.push_back(&p->_item);
+         }
+         auto by_id = [](const value_type* a, const value_type* b) { return a->id < b->id; };
+         if (!std::is_sorted(values.begin(), values.end(), by_id))
+            std::sort(values.begin(), values.end(), by_id);
+         bulk_insert_impl(values);
+         if (!values.empty())
+         {
+            if (std::get<0>(_indices).begin()->id < _next_id)
+               eosio::check(false, "bulk_load ids must be at least next_id");
+            _next_id = std::get<0>(_indices).rbegin()->id;
+            ++_next_id;
+         }
+         guard0.cancel();
+      }
+
       // Exception safety: basic.
       // If the modifier leaves the object in a state that conflicts
       // with another object, it will either be reverted or erased.
@@ -642,6 +1028,21 @@ namespace chainbase
          return {_revision - _undo_stack.size(), _revision};
       }
 
+      id_type next_id() const { return _next_id; }
+
+      // Sets the id which the next emplace will assign. Used when restoring
+      // objects (e.g. from a snapshot) whose ids are not contiguous.
+      void set_next_id(id_type next_id)
+      {
+         if (_undo_stack.size() != 0)
+            eosio::check(false, "cannot set next id while there is an existing undo stack");
+
+         if (next_id < _next_id)
+            eosio::check(false, "next id cannot decrease");
+
+         _next_id = next_id;
+      }
+
       /**
        * Discards all undo history prior to revision
        */
@@ -678,6 +1079,8 @@ namespace chainbase
 
       bool empty() const { return std::get<0>(_indices).empty(); }
 
+      allocator_type get_allocator() const { return allocator_type{_allocator}; }
+
       template <typename Tag, typename Iter>
       auto project(Iter iter) const
       {
@@ -688,7 +1091,7 @@ namespace chainbase
       auto project(Iter iter) const
       {
          if (iter == get<boost::mp11::mp_find<
-                         boost::mp11::mp_list<typename set_impl<node, Indices>::const_iterator...>,
+                         boost::mp11::mp_list<typename index_set<node, Indices>::const_iterator...>,
                          Iter>::value>()
                          .end())
             return get<N>().end();
@@ -697,13 +1100,34 @@ namespace chainbase
 
       bool has_undo_session() const { return !_undo_stack.empty(); }
 
+      struct memory_usage
+      {
+         std::size_t rows = 0;
+         std::size_t old_values = 0;
+         std::size_t removed_values = 0;
+         std::size_t bytes = 0;
+      };
+
+      // Approximate memory held by rows and the undo stack. Only node sizes are
+      // counted; storage owned by the objects (e.g. strings) isn't included.
+      memory_usage get_memory_usage() const
+      {
+         memory_usage result;
+         result.rows = size();
+         // list_base keeps a constant-time size, so this doesn't walk the undo stack
+         result.old_values = _old_values.size();
+         result.removed_values = _removed_values.size();
+         result.bytes = (result.rows + result.removed_values) * sizeof(node) +
+                        result.old_values * sizeof(old_node) +
+                        _undo_stack.size() * sizeof(undo_state);
+         return result;
+      }
+
       struct delta
       {
-         boost::mpl::iterator_range<typename index0_set_type::const_iterator> new_values;
-         boost::mpl::iterator_range<typename list_base<old_node, index0_type>::const_iterator>
-             old_values;
-         boost::mpl::iterator_range<typename list_base<node, index0_type>::const_iterator>
-             removed_values;
+         iterator_range<typename index0_set_type::const_iterator> new_values;
+         iterator_range<typename list_base<old_node, index0_type>::const_iterator> old_values;
+         iterator_range<typename list_base<node, index0_type>::const_iterator> removed_values;
       };
 
       delta last_undo_session() const
@@ -723,6 +1147,51 @@ namespace chainbase
       auto begin() const { return get<0>().begin(); }
       auto end() const { return get<0>().end(); }
 
+      // The rows as they were before the oldest undo session, in id order.
+      // This is the state undo_all would restore, but the table isn't
+      // changed. The pointers are invalidated by the next modification.
+      std::vector<const value_type*> committed_rows() const
+      {
+         std::vector<const value_type*> result;
+         auto& by_id = get<0>();
+         if (_undo_stack.empty())
+         {
+            result.reserve(size());
+            for (auto& obj : by_id)
+               result.push_back(&obj);
+            return result;
+         }
+         const undo_state& bottom = _undo_stack.front();
+         for (auto it = by_id.begin(), end = by_id.lower_bound(bottom.old_next_id); it != end; ++it)
+            result.push_back(&*it);
+         auto num_present = result.size();
+         for (auto it = _removed_values.begin(), end = get_removed_values_end(bottom); it != end;
+              ++it)
+            if (it->id < bottom.old_next_id)
+               result.push_back(&*it);
+         auto by_id_less = [](const value_type* a, const value_type* b) { return a->id < b->id; };
+         std::sort(result.begin() + num_present, result.end(), by_id_less);
+         std::inplace_merge(result.begin(), result.begin() + num_present, result.end(), by_id_less);
+         // A row modified since the bottom session started has exactly one
+         // backup which predates the session. That backup is its committed
+         // value.
+         for (auto it = _old_values.begin(), end = get_old_values_end(bottom); it != end; ++it)
+         {
+            if (to_old_node(*it)._mtime >= bottom.ctime)
+               continue;
+            auto pos = std::lower_bound(result.begin(), result.end(), &*it, by_id_less);
+            assert(pos != result.end() && (*pos)->id == it->id);
+            *pos = &*it;
+         }
+         return result;
+      }
+
+      // The next_id of the state returned by committed_rows
+      id_type committed_next_id() const
+      {
+         return _undo_stack.empty() ? _next_id : _undo_stack.front().old_next_id;
+      }
+
       void undo_all()
       {
          while (!_undo_stack.empty())
@@ -883,6 +1352,52 @@ namespace chainbase
          return true;
       }
 
+      // Links every value into each index. values must be sorted by id.
+      template <int N = 0>
+      void bulk_insert_impl(const std::vector<value_type*>& values)
+      {
+         if constexpr (N < sizeof...(Indices))
+         {
+            auto& idx = std::get<N>(_indices);
+            using index_type = boost::mp11::mp_at_c<boost::mp11::mp_list<Indices...>, N>;
+            if constexpr (is_hashed_index<index_type>)
+            {
+               idx.reserve(values.size());
+               for (auto* v : values)
+                  if (!idx.insert_unique(*v).second)
+                     eosio::check(false,
+                                  "could not insert object, most likely a uniqueness constraint "
+                                  "was violated");
+            }
+            else
+            {
+               // Sorting copies of the keys avoids a cache miss per comparison. The
+               // sort is stable, so equal keys in a non-unique index stay in id order.
+               using key_of_value =
+                   get_key<typename index_type::key_from_value_type, value_type>;
+               using compare = typename index_type::compare_type;
+               std::vector<std::pair<typename key_of_value::type, value_type*>> keyed;
+               keyed.reserve(values.size());
+               for (auto* v : values)
+                  keyed.emplace_back(key_of_value{}(*v), v);
+               auto comp = [](const auto& a, const auto& b) { return compare{}(a.first, b.first); };
+               if (!std::is_sorted(keyed.begin(), keyed.end(), comp))
+                  std::stable_sort(keyed.begin(), keyed.end(), comp);
+               if constexpr (!is_ordered_non_unique_index<index_type>)
+               {
+                  auto not_less = [&](const auto& a, const auto& b) { return !comp(a, b); };
+                  if (std::adjacent_find(keyed.begin(), keyed.end(), not_less) != keyed.end())
+                     eosio::check(false,
+                                  "could not insert object, most likely a uniqueness constraint "
+                                  "was violated");
+               }
+               for (auto& [_, v] : keyed)
+                  idx.push_back(*v);
+            }
+            bulk_insert_impl<N + 1>(values);
+         }
+      }
+
       // Moves a modified node into the correct location
       template <bool unique, int N = 0>
       bool post_modify(value_type& p)
@@ -890,40 +1405,50 @@ namespace chainbase
          if constexpr (N < sizeof...(Indices))
          {
             auto& idx = std::get<N>(_indices);
-            auto iter = idx.iterator_to(p);
-            bool fixup = false;
-            if (iter != idx.begin())
+            using index_type = boost::mp11::mp_at_c<boost::mp11::mp_list<Indices...>, N>;
+            if constexpr (is_hashed_index<index_type>)
             {
-               auto copy = iter;
-               --copy;
-               if (!idx.value_comp()(*copy, p))
-                  fixup = true;
+               if (!idx.template relink<unique>(p))
+                  return false;
+               return post_modify<unique, N + 1>(p);
             }
-            ++iter;
-            if (iter != idx.end())
-            {
-               if (!idx.value_comp()(p, *iter))
-                  fixup = true;
-            }
-            if (fixup)
+            else
             {
-               auto iter2 = idx.iterator_to(p);
-               idx.erase(iter2);
-               if constexpr (unique)
+               auto iter = idx.iterator_to(p);
+               bool fixup = false;
+               if (iter != idx.begin())
                {
-                  auto [new_pos, inserted] = idx.insert_unique(p);
-                  if (!inserted)
-                  {
-                     idx.insert_before(new_pos, p);
-                     return false;
-                  }
+                  auto copy = iter;
+                  --copy;
+                  if (!idx.value_comp()(*copy, p))
+                     fixup = true;
                }
-               else
+               ++iter;
+               if (iter != idx.end())
                {
-                  idx.insert_equal(p);
+                  if (!idx.value_comp()(p, *iter))
+                     fixup = true;
+               }
+               if (fixup)
+               {
+                  auto iter2 = idx.iterator_to(p);
+                  idx.erase(iter2);
+                  if constexpr (unique)
+                  {
+                     auto [new_pos, inserted] = idx.insert_unique(p);
+                     if (!inserted)
+                     {
+                        idx.insert_before(new_pos, p);
+                        return false;
+                     }
+                  }
+                  else
+                  {
+                     idx.insert_equal(p);
+                  }
                }
+               return post_modify<unique, N + 1>(p);
             }
-            return post_modify<unique, N + 1>(p);
          }
          return true;
       }
@@ -1031,6 +1556,10 @@ namespace chainbase
          return static_cast<old_node&>(
              *boost::intrusive::get_parent_from_member(&obj, &value_holder<value_type>::_item));
       }
+      static const old_node& to_old_node(const value_type& obj)
+      {
+         return to_old_node(const_cast<value_type&>(obj));
+      }
 
       auto get_old_values_end(const undo_state& info)
       {
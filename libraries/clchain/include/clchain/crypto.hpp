@@ -2,7 +2,53 @@
 
 #include <eosio/fixed_bytes.hpp>
 
+#include <cstring>
+
+struct evp_md_ctx_st;
+
 namespace clchain
 {
    eosio::checksum256 sha256(const char* data, uint32_t length);
-}
+
+   // Incremental sha256; use with eosio::hash_stream to hash to_bin output
+   // without serializing it to a buffer first. Small writes are buffered, so
+   // to_bin's byte-at-a-time writes don't each call into OpenSSL.
+   class sha256_hasher
+   {
+     public:
+      sha256_hasher();
+      ~sha256_hasher();
+      sha256_hasher(const sha256_hasher&) = delete;
+      sha256_hasher& operator=(const sha256_hasher&) = delete;
+
+      void update(const char* data, size_t length)
+      {
+         if (length <= sizeof(buffer) - buffered)
+         {
+            memcpy(buffer + buffered, data, length);
+            buffered += length;
+            return;
+         }
+         flush();
+         if (length < sizeof(buffer))
+         {
+            memcpy(buffer, data, length);
+            buffered = length;
+         }
+         else
+         {
+            update_ctx(data, length);
+         }
+      }
+
+      eosio::checksum256 finish();
+
+     private:
+      void flush();
+      void update_ctx(const char* data, size_t length);
+
+      evp_md_ctx_st* ctx;
+      size_t buffered = 0;
+      char buffer[256];
+   };
+}  // namespace clchain
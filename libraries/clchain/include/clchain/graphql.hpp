@@ -1,24 +1,54 @@
 #pragma once
 
+#include <algorithm>
 #include <cctype>
 #include <charconv>
+#include <clchain/query_stats.hpp>
 #include <eosio/asset.hpp>
 #include <eosio/bytes.hpp>
 #include <eosio/crypto.hpp>
 #include <eosio/fixed_bytes.hpp>
 #include <eosio/for_each_field.hpp>
+#include <eosio/from_bin.hpp>
 #include <eosio/from_string.hpp>
 #include <eosio/name.hpp>
 #include <eosio/stream.hpp>
 #include <eosio/time.hpp>
+#include <eosio/to_bin.hpp>
 #include <eosio/types.hpp>
+#include <functional>
+#include <memory>
+#include <optional>
 #include <set>
 #include <typeindex>
 
 namespace clchain
 {
    struct gql_stream;
-}
+   struct gql_token;
+
+   // Wraps an output stream to request binary query results. Selected fields
+   // are written in selection order with to_bin and no names. Optionals and
+   // pointers are prefixed with a bool, containers with a varuint32 size, and
+   // each element of a lazy list with true, followed by false after the last.
+   template <typename Base>
+   struct gql_bin_stream : Base
+   {
+      using Base::Base;
+   };
+
+   template <typename S>
+   constexpr bool is_gql_bin_stream(const S*)
+   {
+      return false;
+   }
+
+   template <typename Base>
+   constexpr bool is_gql_bin_stream(const gql_bin_stream<Base>*)
+   {
+      return true;
+   }
+}  // namespace clchain
 
 namespace eosio
 {
@@ -55,7 +85,10 @@ namespace eosio
                   OS& output_stream,
                   const E& error) -> std::enable_if_t<use_json_string_for_gql((T*)nullptr), bool>
    {
-      to_json(value, output_stream);
+      if constexpr (clchain::is_gql_bin_stream((OS*)nullptr))
+         to_bin(value, output_stream);
+      else
+         to_json(value, output_stream);
       return true;
    }
 }  // namespace eosio
@@ -76,6 +109,57 @@ namespace clchain
       static constexpr bool value = sizeof(test<T>((const char**)nullptr)) == sizeof(char);
    };
 
+   // A non-owning reference to a callable. Unlike std::function it never
+   // allocates; the callable must outlive the reference.
+   template <typename Signature>
+   class function_ref;
+
+   template <typename R, typename... Args>
+   class function_ref<R(Args...)>
+   {
+     public:
+      template <typename F,
+                typename =
+                    std::enable_if_t<!std::is_same_v<eosio::remove_cvref_t<F>, function_ref>>>
+      function_ref(F&& f)
+          : object(const_cast<void*>(static_cast<const void*>(std::addressof(f)))),
+            call([](void* object, Args... args) -> R {
+               return (*static_cast<std::remove_reference_t<F>*>(object))(
+                   std::forward<Args>(args)...);
+            })
+      {
+      }
+
+      R operator()(Args... args) const { return call(object, std::forward<Args>(args)...); }
+
+     private:
+      void* object;
+      R (*call)(void*, Args...);
+   };
+
+   // A list whose elements are produced while the result is written instead
+   // of being stored. for_each calls its argument with each element, stopping
+   // early if it returns false; elements only need to live during that call.
+   // for_each refers to a callable owned elsewhere, e.g. by the object the
+   // list came from.
+   template <typename T>
+   struct gql_lazy_list
+   {
+      using value_type = T;
+
+      function_ref<void(function_ref<bool(const T&)>)> for_each;
+   };
+
+   template <typename T>
+   struct is_gql_lazy_list : std::false_type
+   {
+   };
+
+   template <typename T>
+   struct is_gql_lazy_list<gql_lazy_list<T>> : std::true_type
+   {
+   };
+
    template <typename Raw>
    std::string generate_gql_whole_name(Raw*, bool is_optional = false);
 
@@ -100,7 +184,7 @@ namespace clchain
          return "Float";
       else if constexpr (std::is_same_v<T, std::string>)
          return "String";
-      else if constexpr (eosio::is_serializable_container<T>())
+      else if constexpr (eosio::is_serializable_container<T>() || is_gql_lazy_list<T>())
          return "[" + generate_gql_whole_name((typename T::value_type*)nullptr) + "]";
       else if constexpr (eosio::reflection::has_for_each_field_v<T> && !has_get_gql_name<T>::value)
          return get_type_name((T*)nullptr);
@@ -140,7 +224,7 @@ namespace clchain
          fill_gql_schema((typename T::element_type*)nullptr, stream, defined_types);
       else if constexpr (eosio::is_std_reference_wrapper<T>())
          fill_gql_schema((typename T::type*)nullptr, stream, defined_types);
-      else if constexpr (eosio::is_serializable_container<T>())
+      else if constexpr (eosio::is_serializable_container<T>() || is_gql_lazy_list<T>())
          fill_gql_schema((typename T::value_type*)nullptr, stream, defined_types);
       else if constexpr (eosio::reflection::has_for_each_field_v<T> && !has_get_gql_name<T>::value)
       {
@@ -246,14 +330,31 @@ namespace clchain
       std::string_view current_value;
       char current_puncuator = 0;
 
+      // Prepared queries supply tokens instead of input. current_token is
+      // null at eof and for variables, whose values come from bindings.
+      bool prepared = false;
+      const gql_token* token_pos = nullptr;
+      const gql_token* token_end = nullptr;
+      const gql_token* bindings = nullptr;
+      const gql_token* current_token = nullptr;
+
       gql_stream(eosio::input_stream input) : input{input} { skip(); }
+      gql_stream(const gql_token* begin, const gql_token* end, const gql_token* bindings)
+          : prepared{true}, token_pos{begin}, token_end{end}, bindings{bindings}
+      {
+         skip();
+      }
       gql_stream(const gql_stream&) = default;
       gql_stream& operator=(const gql_stream&) = default;
 
+      void skip_token();
+
       void skip()
       {
          if (current_type == error)
             return;
+         if (prepared)
+            return skip_token();
          current_puncuator = 0;
          current_value = {};
          while (true)
@@ -390,7 +491,7 @@ namespace clchain
                {
                   ++input.pos;
                   current_type = floating;
-                  if (input.remaining() && input.pos[0] == '-')
+                  if (input.remaining() && (input.pos[0] == '-' || input.pos[0] == '+'))
                      ++input.pos;
                   if (!input.remaining() || !std::isdigit((unsigned char)input.pos[0]))
                   {
@@ -419,6 +520,248 @@ namespace clchain
       }     // skip()
    };       // gql_stream
 
+   // A token of a prepared query. A variable reference ($name) is a single
+   // token. field_index caches the reflected member a field name resolved to;
+   // each field name token always resolves against the same type.
+   struct gql_token
+   {
+      static constexpr uint32_t none = 0xffff'ffff;
+
+      gql_stream::token_type type = gql_stream::eof;
+      std::string_view value;
+      char puncuator = 0;
+      uint32_t variable = none;
+      mutable uint32_t field_index = none;
+   };
+
+   inline void gql_stream::skip_token()
+   {
+      if (token_pos == token_end)
+      {
+         current_token = nullptr;
+         current_type = eof;
+         current_value = {};
+         current_puncuator = 0;
+         return;
+      }
+      auto* token = token_pos++;
+      current_token = token->variable == gql_token::none ? token : nullptr;
+      if (!current_token)
+         token = &bindings[token->variable];
+      current_type = token->type;
+      current_value = token->value;
+      current_puncuator = token->puncuator;
+   }
+
+   struct gql_variable
+   {
+      std::string_view name;
+      std::optional<gql_token> default_value;
+      bool required = false;
+   };
+
+   // A query which has been tokenized once and can be executed repeatedly
+   // with different variables. Tokens refer to text, so this is neither
+   // copyable nor movable; gql_prepare returns it by pointer. A prepared
+   // query must always be executed against the same root type, and by one
+   // thread at a time, since executing it caches field lookups in tokens.
+   struct gql_prepared_query
+   {
+      std::string text;
+      std::vector<gql_token> tokens;
+      std::vector<gql_variable> variables;
+      std::string error;
+
+      gql_prepared_query() = default;
+      gql_prepared_query(const gql_prepared_query&) = delete;
+      gql_prepared_query& operator=(const gql_prepared_query&) = delete;
+   };
+
+   inline bool gql_token_ok(const gql_stream& input_stream)
+   {
+      // An unterminated string leaves current_value empty without setting a type
+      return input_stream.current_type != gql_stream::error &&
+             (input_stream.current_type == gql_stream::eof ||
+              input_stream.current_value.data() != nullptr);
+   }
+
+   inline gql_token gql_current_token(const gql_stream& input_stream)
+   {
+      return {
+          .type = input_stream.current_type,
+          .value = input_stream.current_value,
+          .puncuator = input_stream.current_puncuator,
+      };
+   }
+
+   inline bool gql_is_scalar_token(const gql_stream& input_stream)
+   {
+      return input_stream.current_type == gql_stream::string ||
+             input_stream.current_type == gql_stream::integer ||
+             input_stream.current_type == gql_stream::floating ||
+             input_stream.current_type == gql_stream::name;
+   }
+
+   // Parses variable definitions: ($name: Type = default ...)
+   template <typename E>
+   bool gql_parse_variable_definitions(std::vector<gql_variable>& variables,
+                                       gql_stream& input_stream,
+                                       const E& error)
+   {
+      input_stream.skip();
+      while (input_stream.current_puncuator == '$')
+      {
+         gql_variable variable;
+         input_stream.skip();
+         if (input_stream.current_type != gql_stream::name)
+            return error("expected variable name");
+         variable.name = input_stream.current_value;
+         for (auto& v : variables)
+            if (v.name == variable.name)
+               return error("duplicate variable $" + std::string(variable.name));
+         input_stream.skip();
+         if (input_stream.current_puncuator != ':')
+            return error("expected :");
+         input_stream.skip();
+         uint32_t depth = 0;
+         for (; input_stream.current_puncuator == '['; ++depth)
+            input_stream.skip();
+         if (input_stream.current_type != gql_stream::name)
+            return error("expected type");
+         input_stream.skip();
+         variable.required = input_stream.current_puncuator == '!';
+         if (variable.required)
+            input_stream.skip();
+         for (; depth; --depth)
+         {
+            if (input_stream.current_puncuator != ']')
+               return error("expected ]");
+            input_stream.skip();
+            variable.required = input_stream.current_puncuator == '!';
+            if (variable.required)
+               input_stream.skip();
+         }
+         if (input_stream.current_puncuator == '=')
+         {
+            input_stream.skip();
+            if (!gql_is_scalar_token(input_stream) || !gql_token_ok(input_stream))
+               return error("only scalar variable defaults are supported");
+            variable.default_value = gql_current_token(input_stream);
+            input_stream.skip();
+         }
+         variables.push_back(variable);
+      }
+      if (input_stream.current_puncuator != ')')
+         return error("expected )");
+      input_stream.skip();
+      return true;
+   }
+
+   template <typename E>
+   bool gql_tokenize(gql_prepared_query& query, const E& error)
+   {
+      gql_stream input_stream{eosio::input_stream{query.text}};
+      if (input_stream.current_type == gql_stream::name && input_stream.current_value == "query")
+      {
+         input_stream.skip();
+         if (input_stream.current_type == gql_stream::name)
+            input_stream.skip();
+         if (input_stream.current_puncuator == '(' &&
+             !gql_parse_variable_definitions(query.variables, input_stream, error))
+            return false;
+         if (input_stream.current_puncuator == '@')
+            return error("directives not supported");
+      }
+      while (input_stream.current_type != gql_stream::eof)
+      {
+         if (!gql_token_ok(input_stream))
+            return error("syntax error");
+         auto token = gql_current_token(input_stream);
+         if (input_stream.current_puncuator == '$')
+         {
+            input_stream.skip();
+            auto it = std::find_if(query.variables.begin(), query.variables.end(), [&](auto& v) {
+               return input_stream.current_type == gql_stream::name &&
+                      v.name == input_stream.current_value;
+            });
+            if (it == query.variables.end())
+               return error("undefined variable $" + std::string(input_stream.current_value));
+            token.variable = it - query.variables.begin();
+         }
+         query.tokens.push_back(token);
+         input_stream.skip();
+      }
+      return true;
+   }
+
+   // Errors are reported when the query is executed
+   inline std::unique_ptr<gql_prepared_query> gql_prepare(std::string_view query)
+   {
+      auto result = std::make_unique<gql_prepared_query>();
+      result->text = query;
+      gql_tokenize(*result, [&](const auto& e) {
+         result->error = e;
+         result->tokens.clear();
+         return false;
+      });
+      return result;
+   }
+
+   // Binds values from a JSON object. Values must be scalars.
+   template <typename E>
+   bool gql_bind_variables(const gql_prepared_query& query,
+                           std::string_view variables,
+                           std::vector<gql_token>& bindings,
+                           const E& error)
+   {
+      bindings.assign(query.variables.size(), {});
+      std::vector<bool> bound(query.variables.size());
+      gql_stream input_stream{variables};
+      if (input_stream.current_type != gql_stream::eof)
+      {
+         if (input_stream.current_puncuator != '{')
+            return error("variables must be an object");
+         input_stream.skip();
+         while (input_stream.current_type == gql_stream::string)
+         {
+            auto name = input_stream.current_value;
+            input_stream.skip();
+            if (input_stream.current_puncuator != ':')
+               return error("expected : in variables");
+            input_stream.skip();
+            if (!gql_is_scalar_token(input_stream) || !gql_token_ok(input_stream))
+               return error("only scalar variables are supported");
+            for (size_t i = 0; i < query.variables.size(); ++i)
+            {
+               if (query.variables[i].name == name)
+               {
+                  bindings[i] = gql_current_token(input_stream);
+                  bound[i] = true;
+               }
+            }
+            input_stream.skip();
+         }
+         if (input_stream.current_puncuator != '}')
+            return error("expected } in variables");
+         input_stream.skip();
+         if (input_stream.current_type != gql_stream::eof)
+            return error("expected end of variables");
+      }
+      for (size_t i = 0; i < query.variables.size(); ++i)
+      {
+         auto& variable = query.variables[i];
+         if (bound[i])
+            continue;
+         if (variable.default_value)
+            bindings[i] = *variable.default_value;
+         else if (variable.required)
+            return error("missing variable $" + std::string(variable.name));
+         else
+            bindings[i] = {.type = gql_stream::name, .value = "null"};
+      }
+      return true;
+   }
+
    template <typename E>
    auto gql_parse_arg(std::string& arg, gql_stream& input_stream, const E& error)
    {
@@ -563,7 +906,10 @@ namespace clchain
    auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
        -> std::enable_if_t<std::is_arithmetic_v<T> || std::is_same_v<T, std::string>, bool>
    {
-      eosio::to_json(value, output_stream);
+      if constexpr (is_gql_bin_stream((OS*)nullptr))
+         eosio::to_bin(value, output_stream);
+      else
+         eosio::to_json(value, output_stream);
       return true;
    }
 
@@ -573,9 +919,12 @@ namespace clchain
                                eosio::is_std_unique_ptr<T>(),
                            bool>
    {
+      if constexpr (is_gql_bin_stream((OS*)nullptr))
+         eosio::to_bin(bool(value), output_stream);
       if (value)
          return gql_query(*value, input_stream, output_stream, error);
-      write_str("null", output_stream);
+      if constexpr (!is_gql_bin_stream((OS*)nullptr))
+         write_str("null", output_stream);
       return gql_skip_selection_set(input_stream, error);
    }
 
@@ -590,13 +939,17 @@ namespace clchain
    auto gql_query(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
        -> std::enable_if_t<eosio::is_serializable_container<T>::value, bool>
    {
-      output_stream.write('[');
+      constexpr bool bin = is_gql_bin_stream((OS*)nullptr);
+      if constexpr (bin)
+         eosio::varuint32_to_bin(value.size(), output_stream);
+      else
+         output_stream.write('[');
       bool first = true;
       for (auto& v : value)
       {
          if (first)
             increase_indent(output_stream);
-         else
+         else if constexpr (!bin)
             output_stream.write(',');
          write_newline(output_stream);
          first = false;
@@ -611,7 +964,45 @@ namespace clchain
          decrease_indent(output_stream);
          write_newline(output_stream);
       }
-      output_stream.write(']');
+      if constexpr (!bin)
+         output_stream.write(']');
+      return true;
+   }
+
+   template <typename T, typename OS, typename E>
+   bool gql_query(const gql_lazy_list<T>& value,
+                  gql_stream& input_stream,
+                  OS& output_stream,
+                  const E& error)
+   {
+      constexpr bool bin = is_gql_bin_stream((OS*)nullptr);
+      if constexpr (!bin)
+         output_stream.write('[');
+      bool first = true;
+      bool ok = true;
+      value.for_each([&](const T& v) {
+         if constexpr (bin)
+            eosio::to_bin(true, output_stream);
+         if (first)
+            increase_indent(output_stream);
+         else if constexpr (!bin)
+            output_stream.write(',');
+         write_newline(output_stream);
+         first = false;
+         auto copy = input_stream;
+         return ok = gql_query(v, copy, output_stream, error);
+      });
+      if (!ok || !gql_skip_selection_set(input_stream, error))
+         return false;
+      if constexpr (bin)
+         eosio::to_bin(false, output_stream);
+      if (!first)
+      {
+         decrease_indent(output_stream);
+         write_newline(output_stream);
+      }
+      if constexpr (!bin)
+         output_stream.write(']');
       return true;
    }
 
@@ -622,17 +1013,20 @@ namespace clchain
                            bool>
    {
       using T = eosio::remove_cvref_t<Raw>;
+      constexpr bool bin = is_gql_bin_stream((OS*)nullptr);
       if (input_stream.current_puncuator != '{')
          return error("expected {");
       input_stream.skip();
       bool first = true;
-      output_stream.write('{');
+      if constexpr (!bin)
+         output_stream.write('{');
       while (input_stream.current_type == gql_stream::name)
       {
          bool found = false;
          bool ok = true;
          auto alias = input_stream.current_value;
          auto field_name = alias;
+         auto* field_token = input_stream.current_token;
          input_stream.skip();
          if (input_stream.current_puncuator == ':')
          {
@@ -640,30 +1034,40 @@ namespace clchain
             if (input_stream.current_type != gql_stream::name)
                return error("expected name after :");
             field_name = input_stream.current_value;
+            field_token = input_stream.current_token;
             input_stream.skip();
          }
+         bool resolved = field_token && field_token->field_index != gql_token::none;
+         uint32_t index = 0;
          eosio_for_each_field((T*)nullptr, [&](std::string_view name, auto&& member,
                                                auto... arg_names) {
             using member_type = decltype(member((T*)nullptr));
+            auto i = index++;
             if constexpr (eosio::is_non_const_member_fn<member_type>())
                return;
             else
             {
                if (found)
                   return;
-               if (name == field_name)
+               if (resolved ? i == field_token->field_index : name == field_name)
                {
                   found = true;
+                  if (field_token)
+                     field_token->field_index = i;
+                  query_field_scope<OS> stats_scope{field_name, output_stream};
                   if (first)
                   {
                      increase_indent(output_stream);
                      first = false;
                   }
-                  else
+                  else if constexpr (!bin)
                      output_stream.write(',');
                   write_newline(output_stream);
-                  to_json(alias, output_stream);
-                  write_colon(output_stream);
+                  if constexpr (!bin)
+                  {
+                     to_json(alias, output_stream);
+                     write_colon(output_stream);
+                  }
                   if constexpr (std::is_member_object_pointer_v<member_type>)
                   {
                      if (!gql_query(value.*member(&value), input_stream, output_stream, error))
@@ -725,12 +1129,15 @@ namespace clchain
          decrease_indent(output_stream);
          write_newline(output_stream);
       }
-      output_stream.write('}');
+      if constexpr (!bin)
+         output_stream.write('}');
       return true;
    }
 
-   template <typename T, typename OS, typename E>
-   bool gql_query_root(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   // Checks the operation around the root selection set, using
+   // query_selection to process the selection set itself
+   template <typename E, typename F>
+   bool gql_query_operation(gql_stream& input_stream, const E& error, F&& query_selection)
    {
       if (input_stream.current_type == gql_stream::name)
       {
@@ -753,7 +1160,7 @@ namespace clchain
          else
             return error("expected query");
       }
-      if (!gql_query(value, input_stream, output_stream, error))
+      if (!query_selection())
          return false;
       if (input_stream.current_type == gql_stream::eof)
          return true;
@@ -771,46 +1178,325 @@ namespace clchain
       return error("expected end of input");
    }
 
+   template <typename T, typename OS, typename E>
+   bool gql_query_root(const T& value, gql_stream& input_stream, OS& output_stream, const E& error)
+   {
+      if (gql_query_stats.enabled)
+         gql_query_stats.count_query();
+      return gql_query_operation(input_stream, error, [&] {
+         return gql_query(value, input_stream, output_stream, error);
+      });
+   }
+
+   // Binds variables to a prepared query and calls f with a stream over it
+   template <typename E, typename F>
+   bool gql_run_prepared(const gql_prepared_query& query,
+                         std::string_view variables,
+                         const E& error,
+                         F&& f)
+   {
+      if (!query.error.empty())
+         return error(query.error);
+      std::vector<gql_token> bindings;
+      if (!gql_bind_variables(query, variables, bindings, error))
+         return false;
+      gql_stream input_stream{query.tokens.data(), query.tokens.data() + query.tokens.size(),
+                              bindings.data()};
+      return f(input_stream);
+   }
+
+   template <typename S>
+   void gql_write_error(const std::string& error, S& error_stream)
+   {
+      error_stream.write('{');
+      increase_indent(error_stream);
+      write_newline(error_stream);
+      write_str("\"errors\"", error_stream);
+      write_colon(error_stream);
+      error_stream.write('{');
+      increase_indent(error_stream);
+      write_newline(error_stream);
+      write_str("\"message\"", error_stream);
+      write_colon(error_stream);
+      eosio::to_json(error, error_stream);
+      decrease_indent(error_stream);
+      write_newline(error_stream);
+      error_stream.write('}');
+      decrease_indent(error_stream);
+      write_newline(error_stream);
+      error_stream.write('}');
+   }
+
+   // Runs a query, producing JSON. Stream controls formatting; the default
+   // writes no whitespace.
    template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
-   std::string gql_query(const T& value, std::string_view query, std::string_view variables)
+   std::string gql_query(const T& value,
+                         const gql_prepared_query& query,
+                         std::string_view variables)
    {
-      gql_stream input_stream{query};
       std::string result;
       Stream output_stream(result);
       output_stream.write('{');
       increase_indent(output_stream);
       write_newline(output_stream);
-      write_str("\"data\": ", output_stream);
+      write_str("\"data\"", output_stream);
+      write_colon(output_stream);
       std::string error;
-      bool ok = true;
-      if (!variables.empty())
+      auto on_error = [&](const auto& e) {
+         error = e;
+         return false;
+      };
+      if (!gql_run_prepared(query, variables, on_error, [&](gql_stream& input_stream) {
+             return gql_query_root(value, input_stream, output_stream, on_error);
+          }))
       {
-         error = "variables not supported; argument must be empty";
-         ok = false;
+         result.clear();
+         Stream error_stream(result);
+         gql_write_error(error, error_stream);
+         return result;
       }
-      else
-         ok = gql_query_root(value, input_stream, output_stream, [&](const auto& e) {
-            error = e;
+      decrease_indent(output_stream);
+      write_newline(output_stream);
+      output_stream.write('}');
+      return result;
+   }
+
+   template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
+   std::string gql_query(const T& value, std::string_view query, std::string_view variables)
+   {
+      return gql_query<Stream>(value, *gql_prepare(query), variables);
+   }
+
+   // Runs a query, producing the format described at gql_bin_stream. The
+   // result starts with true followed by the data, or with false followed by
+   // the error message. gql_bin_to_json converts it to gql_query's format.
+   template <typename T>
+   std::vector<char> gql_query_bin(const T& value,
+                                   const gql_prepared_query& query,
+                                   std::string_view variables)
+   {
+      std::vector<char> result;
+      gql_bin_stream<eosio::vector_stream> output_stream(result);
+      eosio::to_bin(true, output_stream);
+      std::string error;
+      auto on_error = [&](const auto& e) {
+         error = e;
+         return false;
+      };
+      if (!gql_run_prepared(query, variables, on_error, [&](gql_stream& input_stream) {
+             return gql_query_root(value, input_stream, output_stream, on_error);
+          }))
+      {
+         result.clear();
+         eosio::to_bin(false, output_stream);
+         eosio::to_bin(error, output_stream);
+      }
+      return result;
+   }
+
+   // Converts a value written by gql_query_bin to JSON. The layout isn't
+   // stored in the data; it comes from the query and the reflected types.
+   template <typename Raw, typename OS, typename E>
+   bool gql_bin_to_json(Raw*,
+                        gql_stream& input_stream,
+                        eosio::input_stream& bin,
+                        OS& output_stream,
+                        const E& error)
+   {
+      using T = eosio::remove_cvref_t<Raw>;
+      if constexpr (eosio::is_std_optional<T>() || std::is_pointer<T>() ||
+                    eosio::is_std_unique_ptr<T>())
+      {
+         using U = eosio::remove_cvref_t<decltype(*std::declval<const T&>())>;
+         bool has_value;
+         eosio::from_bin(has_value, bin);
+         if (has_value)
+            return gql_bin_to_json((U*)nullptr, input_stream, bin, output_stream, error);
+         write_str("null", output_stream);
+         return gql_skip_selection_set(input_stream, error);
+      }
+      else if constexpr (eosio::is_std_reference_wrapper<T>())
+         return gql_bin_to_json((typename T::type*)nullptr, input_stream, bin, output_stream,
+                                error);
+      else if constexpr (eosio::is_serializable_container<T>() || is_gql_lazy_list<T>())
+      {
+         uint32_t size = 0;
+         if constexpr (!is_gql_lazy_list<T>())
+            eosio::varuint32_from_bin(size, bin);
+         output_stream.write('[');
+         bool first = true;
+         while (true)
+         {
+            if constexpr (is_gql_lazy_list<T>())
+            {
+               bool more;
+               eosio::from_bin(more, bin);
+               if (!more)
+                  break;
+            }
+            else if (!size--)
+               break;
+            if (first)
+               increase_indent(output_stream);
+            else
+               output_stream.write(',');
+            write_newline(output_stream);
+            first = false;
+            auto copy = input_stream;
+            if (!gql_bin_to_json((typename T::value_type*)nullptr, copy, bin, output_stream,
+                                 error))
+               return false;
+         }
+         if (!gql_skip_selection_set(input_stream, error))
             return false;
+         if (!first)
+         {
+            decrease_indent(output_stream);
+            write_newline(output_stream);
+         }
+         output_stream.write(']');
+         return true;
+      }
+      else if constexpr (eosio::reflection::has_for_each_field_v<T> && !has_get_gql_name<T>::value)
+      {
+         if (input_stream.current_puncuator != '{')
+            return error("expected {");
+         input_stream.skip();
+         bool first = true;
+         output_stream.write('{');
+         while (input_stream.current_type == gql_stream::name)
+         {
+            bool found = false;
+            bool ok = true;
+            auto alias = input_stream.current_value;
+            auto field_name = alias;
+            auto* field_token = input_stream.current_token;
+            input_stream.skip();
+            if (input_stream.current_puncuator == ':')
+            {
+               input_stream.skip();
+               if (input_stream.current_type != gql_stream::name)
+                  return error("expected name after :");
+               field_name = input_stream.current_value;
+               field_token = input_stream.current_token;
+               input_stream.skip();
+            }
+            bool resolved = field_token && field_token->field_index != gql_token::none;
+            uint32_t index = 0;
+            eosio_for_each_field((T*)nullptr, [&](std::string_view name, auto&& member, auto...) {
+               using member_type = decltype(member((T*)nullptr));
+               auto i = index++;
+               if constexpr (eosio::is_non_const_member_fn<member_type>())
+                  return;
+               else
+               {
+                  if (found || !(resolved ? i == field_token->field_index : name == field_name))
+                     return;
+                  found = true;
+                  if (field_token)
+                     field_token->field_index = i;
+                  if (first)
+                  {
+                     increase_indent(output_stream);
+                     first = false;
+                  }
+                  else
+                     output_stream.write(',');
+                  write_newline(output_stream);
+                  to_json(alias, output_stream);
+                  write_colon(output_stream);
+                  if constexpr (std::is_member_object_pointer_v<member_type>)
+                  {
+                     using U = eosio::remove_cvref_t<decltype(std::declval<const T&>().*
+                                                              std::declval<member_type>())>;
+                     ok = gql_bin_to_json((U*)nullptr, input_stream, bin, output_stream, error);
+                  }
+                  else
+                  {
+                     using U =
+                         eosio::remove_cvref_t<typename eosio::member_fn<member_type>::return_type>;
+                     // The arguments were checked when the data was produced
+                     if (input_stream.current_puncuator == '(')
+                     {
+                        while (input_stream.current_puncuator != ')')
+                        {
+                           if (input_stream.current_type == gql_stream::eof)
+                              return (ok = error("expected )")), void();
+                           input_stream.skip();
+                        }
+                        input_stream.skip();
+                     }
+                     ok = gql_bin_to_json((U*)nullptr, input_stream, bin, output_stream, error);
+                  }
+               }
+            });
+            if (!ok)
+               return false;
+            if (!found)
+               return error((std::string)field_name + " not found");
+         }
+         if (input_stream.current_puncuator != '}')
+            return error("expected }");
+         input_stream.skip();
+         if (!first)
+         {
+            decrease_indent(output_stream);
+            write_newline(output_stream);
+         }
+         output_stream.write('}');
+         return true;
+      }
+      else
+      {
+         T value;
+         eosio::from_bin(value, bin);
+         eosio::to_json(value, output_stream);
+         return true;
+      }
+   }
+
+   // Converts the result of gql_query_bin to the result gql_query would have
+   // produced. query and variables must be the ones used to produce bin and
+   // T must be the root type it was produced from.
+   // TODO: prevent from_bin from aborting
+   template <typename Stream = eosio::time_point_include_z_stream<eosio::string_stream>, typename T>
+   std::string gql_bin_to_json(T*,
+                               const gql_prepared_query& query,
+                               std::string_view variables,
+                               eosio::input_stream bin)
+   {
+      std::string result;
+      Stream output_stream(result);
+      std::string error;
+      bool has_data;
+      eosio::from_bin(has_data, bin);
+      if (!has_data)
+      {
+         eosio::from_bin(error, bin);
+         gql_write_error(error, output_stream);
+         return result;
+      }
+      output_stream.write('{');
+      increase_indent(output_stream);
+      write_newline(output_stream);
+      write_str("\"data\"", output_stream);
+      write_colon(output_stream);
+      auto on_error = [&](const auto& e) {
+         error = e;
+         return false;
+      };
+      bool ok = gql_run_prepared(query, variables, on_error, [&](gql_stream& input_stream) {
+         return gql_query_operation(input_stream, on_error, [&] {
+            return gql_bin_to_json((T*)nullptr, input_stream, bin, output_stream, on_error);
          });
+      });
+      if (ok && bin.remaining())
+         ok = on_error("extra data after result");
       if (!ok)
       {
          result.clear();
          Stream error_stream(result);
-         error_stream.write('{');
-         increase_indent(error_stream);
-         write_newline(error_stream);
-         write_str("\"errors\": {", error_stream);
-         increase_indent(error_stream);
-         write_newline(error_stream);
-         write_str("\"message\": ", error_stream);
-         eosio::to_json(error, error_stream);
-         decrease_indent(error_stream);
-         write_newline(error_stream);
-         error_stream.write('}');
-         decrease_indent(error_stream);
-         write_newline(error_stream);
-         error_stream.write('}');
+         gql_write_error(error, error_stream);
          return result;
       }
       decrease_indent(output_stream);
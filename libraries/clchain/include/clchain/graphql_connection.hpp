@@ -4,15 +4,32 @@
 #include <eosio/from_bin.hpp>
 #include <eosio/reflection2.hpp>
 #include <eosio/to_bin.hpp>
+#include <new>
+#include <optional>
 
 namespace clchain
 {
+   // The part of a connection's page that PageInfo reports; see connection_page
+   struct connection_page_info
+   {
+      virtual bool has_next_page() const = 0;
+      virtual std::string start_cursor() const = 0;
+      virtual std::string end_cursor() const = 0;
+
+     protected:
+      ~connection_page_info() = default;
+   };
+
+   // Only exists while a connection is being written. Everything but
+   // hasPreviousPage is computed only if the query selects it.
    struct PageInfo
    {
       bool hasPreviousPage = false;
-      bool hasNextPage = false;
-      std::string startCursor;
-      std::string endCursor;
+      const connection_page_info* page = nullptr;
+
+      bool hasNextPage() const { return page && page->has_next_page(); }
+      std::string startCursor() const { return page ? page->start_cursor() : std::string{}; }
+      std::string endCursor() const { return page ? page->end_cursor() : std::string{}; }
    };
    EOSIO_REFLECT2(PageInfo, hasPreviousPage, hasNextPage, startCursor, endCursor)
 
@@ -24,13 +41,17 @@ namespace clchain
       static constexpr const char* edge_name = EdgeName;
    };
 
+   // Edges only exist while a connection is being written. The cursor is
+   // only computed if the query selects it.
    template <typename Config>
    struct Edge
    {
       using config = Config;
 
       typename Config::value_type node;
-      std::string cursor;
+      function_ref<std::string()> get_cursor;
+
+      std::string cursor() const { return get_cursor(); }
    };
    template <typename Config>
    [[maybe_unused]] inline const char* get_type_name(Edge<Config>*)
@@ -43,13 +64,83 @@ namespace clchain
       EOSIO_REFLECT2_FOR_EACH_FIELD(Edge<Config>, node, cursor)
    }
 
+   // One page of a connection. make_connection implements this and stores
+   // it inside the Connection, which hands out references to it.
+   template <typename Edge>
+   struct connection_page : connection_page_info
+   {
+      virtual ~connection_page() = default;
+      virtual void for_each_edge(function_ref<bool(const Edge&)> f) const = 0;
+      virtual connection_page* copy_to(void* storage) const = 0;
+
+      void operator()(function_ref<bool(const Edge&)> f) const { for_each_edge(f); }
+   };
+
+   // edges and pageInfo refer to the page stored inside the connection, so
+   // they must not outlive it. The page lives in an inline buffer; building
+   // and writing a connection doesn't allocate.
    template <typename Config>
-   struct Connection
+   class Connection
    {
+     public:
       using config = Config;
+      using edge_type = Edge<Config>;
+      using page_type = connection_page<edge_type>;
+
+      // Room for a page's iterators and the to_key and to_node it holds
+      static constexpr std::size_t page_storage_size = 16 * sizeof(void*);
+
+      Connection() = default;
+      Connection(const Connection& src) : has_previous_page(src.has_previous_page)
+      {
+         if (src.page)
+            page = src.page->copy_to(storage);
+      }
+      Connection& operator=(const Connection& src)
+      {
+         if (this != &src)
+         {
+            reset();
+            has_previous_page = src.has_previous_page;
+            if (src.page)
+               page = src.page->copy_to(storage);
+         }
+         return *this;
+      }
+      ~Connection() { reset(); }
 
-      std::vector<Edge<Config>> edges;
-      PageInfo pageInfo;
+      template <typename Page>
+      void set_page(bool has_previous_page, Page&& src)
+      {
+         using P = std::decay_t<Page>;
+         static_assert(sizeof(P) <= page_storage_size, "increase page_storage_size");
+         static_assert(alignof(P) <= alignof(std::max_align_t));
+         reset();
+         this->has_previous_page = has_previous_page;
+         page = new (storage) P(std::forward<Page>(src));
+      }
+
+      gql_lazy_list<edge_type> edges() const
+      {
+         static constexpr auto no_edges = [](function_ref<bool(const edge_type&)>) {};
+         if (page)
+            return {*page};
+         return {no_edges};
+      }
+
+      PageInfo pageInfo() const { return {has_previous_page, page}; }
+
+     private:
+      void reset()
+      {
+         if (page)
+            page->~page_type();
+         page = nullptr;
+      }
+
+      bool has_previous_page = false;
+      page_type* page = nullptr;
+      alignas(std::max_align_t) unsigned char storage[page_storage_size];
    };
    template <typename Config>
    [[maybe_unused]] inline const char* get_type_name(Connection<Config>*)
@@ -62,7 +153,25 @@ namespace clchain
       EOSIO_REFLECT2_FOR_EACH_FIELD(Connection<Config>, edges, pageInfo)
    }
 
-   // To enable cursors to function correctly, container must not have duplicate keys
+   // Page sizes for connections which don't specify first or last, and the
+   // largest page a query may request. 0 means unlimited.
+   struct connection_limits
+   {
+      uint32_t default_page_size = 0;
+      uint32_t max_page_size = 0;
+   };
+   inline connection_limits connection_page_limits;
+
+   template <typename Key>
+   std::string make_cursor(const Key& key)
+   {
+      auto bin = eosio::convert_to_bin(key);
+      return eosio::hex(bin.begin(), bin.end());
+   }
+
+   // To enable cursors to function correctly, container must not have duplicate keys.
+   // The returned connection refers to container and holds copies of to_key and
+   // to_node; they must remain valid until it has been written.
    template <typename Connection,
              typename Key,
              typename T,
@@ -102,60 +211,178 @@ namespace clchain
          return {};
       };
 
+      auto seek_lower = [&](const Key& key) {
+         count_index_seek();
+         return lower_bound(container, key);
+      };
+      auto seek_upper = [&](const Key& key) {
+         count_index_seek();
+         return upper_bound(container, key);
+      };
+
       auto rangeBegin = container.begin();
       auto rangeEnd = container.end();
       if (ge)
-         rangeBegin = std::max(rangeBegin, lower_bound(container, *ge), compare_it);
+         rangeBegin = std::max(rangeBegin, seek_lower(*ge), compare_it);
       if (gt)
-         rangeBegin = std::max(rangeBegin, upper_bound(container, *gt), compare_it);
+         rangeBegin = std::max(rangeBegin, seek_upper(*gt), compare_it);
       if (le)
-         rangeEnd = std::min(rangeEnd, upper_bound(container, *le), compare_it);
+         rangeEnd = std::min(rangeEnd, seek_upper(*le), compare_it);
       if (lt)
-         rangeEnd = std::min(rangeEnd, lower_bound(container, *lt), compare_it);
+         rangeEnd = std::min(rangeEnd, seek_lower(*lt), compare_it);
       rangeEnd = std::max(rangeBegin, rangeEnd, compare_it);
 
       auto it = rangeBegin;
       auto end = rangeEnd;
       if (auto key = key_from_hex(after))
-         it = std::clamp(upper_bound(container, *key), rangeBegin, rangeEnd, compare_it);
+         it = std::clamp(seek_upper(*key), rangeBegin, rangeEnd, compare_it);
       if (auto key = key_from_hex(before))
-         end = std::clamp(lower_bound(container, *key), rangeBegin, rangeEnd, compare_it);
+         end = std::clamp(seek_lower(*key), rangeBegin, rangeEnd, compare_it);
       end = std::max(it, end, compare_it);
 
-      Connection result;
-      auto add_edge = [&](const auto& it) {
-         auto bin = eosio::convert_to_bin(to_key(*it));
-         auto cursor = eosio::hex(bin.begin(), bin.end());
-         result.edges.push_back(Edge<typename Connection::config>{to_node(*it), std::move(cursor)});
-      };
+      auto& limits = connection_page_limits;
+      if (!first && !last)
+      {
+         if (limits.default_page_size)
+            first = limits.default_page_size;
+         else if (limits.max_page_size)
+            first = limits.max_page_size;
+      }
+      if (limits.max_page_size)
+      {
+         if (first)
+            first = std::min(*first, limits.max_page_size);
+         if (last)
+            last = std::min(*last, limits.max_page_size);
+      }
 
+      // Narrow [it, end) to the requested page. Rows walked here are counted
+      // as scanned. first alone is narrowed lazily: the page's end is found
+      // by whichever of edges, hasNextPage, or endCursor needs it first, and
+      // remembered, so the page is walked at most once.
+      using iterator = decltype(it);
+      std::optional<uint32_t> limit;
+      bool scanned = false;
+      bool has_previous_page = it != rangeBegin;
       if (last && !first)
       {
-         result.pageInfo.hasNextPage = end != rangeEnd;
-         for (; it != end && (*last)-- > 0; --end)
-            add_edge(std::prev(end));
-         result.pageInfo.hasPreviousPage = end != rangeBegin;
-         std::reverse(result.edges.begin(), result.edges.end());
+         auto begin = end;
+         uint32_t size = 0;
+         for (; begin != it && size < *last; ++size)
+            --begin;
+         count_rows_scanned(size);
+         scanned = true;
+         it = begin;
+         has_previous_page = it != rangeBegin;
       }
-      else
+      else if (first && last)
       {
-         result.pageInfo.hasPreviousPage = it != rangeBegin;
-         for (; it != end && (!first || (*first)-- > 0); ++it)
-            add_edge(it);
-         result.pageInfo.hasNextPage = it != rangeEnd;
-         if (last && *last < result.edges.size())
+         auto page_end = it;
+         uint32_t size = 0;
+         for (; page_end != end && size < *first; ++page_end)
+            ++size;
+         count_rows_scanned(size);
+         scanned = true;
+         end = page_end;
+         if (*last < size)
          {
-            result.pageInfo.hasPreviousPage = true;
-            result.edges.erase(result.edges.begin(),
-                               result.edges.begin() + (result.edges.size() - *last));
+            has_previous_page = true;
+            std::advance(it, size - *last);
          }
       }
-
-      if (!result.edges.empty())
+      else if (first)
       {
-         result.pageInfo.startCursor = result.edges.front().cursor;
-         result.pageInfo.endCursor = result.edges.back().cursor;
+         limit = first;
       }
+
+      using edge_type = typename Connection::edge_type;
+      using key_fn = std::decay_t<To_key>;
+      using node_fn = std::decay_t<To_node>;
+      struct page final : connection_page<edge_type>
+      {
+         iterator begin, end, range_end;
+         std::optional<uint32_t> limit;
+         mutable std::optional<iterator> page_end;
+         mutable bool scanned;
+         key_fn to_key;
+         node_fn to_node;
+
+         page(iterator begin,
+              iterator end,
+              iterator range_end,
+              std::optional<uint32_t> limit,
+              bool scanned,
+              key_fn to_key,
+              node_fn to_node)
+             : begin(begin),
+               end(end),
+               range_end(range_end),
+               limit(limit),
+               scanned(scanned),
+               to_key(std::move(to_key)),
+               to_node(std::move(to_node))
+         {
+            if (!limit)
+               page_end = end;
+         }
+
+         iterator get_page_end() const
+         {
+            if (!page_end)
+            {
+               auto pos = begin;
+               uint32_t size = 0;
+               for (; pos != end && size < *limit; ++pos)
+                  ++size;
+               count_rows_scanned(size);
+               scanned = true;
+               page_end = pos;
+            }
+            return *page_end;
+         }
+
+         bool has_next_page() const override { return get_page_end() != range_end; }
+
+         std::string start_cursor() const override
+         {
+            if (begin == end || limit == 0u)
+               return {};
+            return make_cursor(to_key(*begin));
+         }
+
+         std::string end_cursor() const override
+         {
+            auto e = get_page_end();
+            if (begin == e)
+               return {};
+            return make_cursor(to_key(*std::prev(e)));
+         }
+
+         void for_each_edge(function_ref<bool(const edge_type&)> f) const override
+         {
+            auto stop = page_end ? *page_end : end;
+            auto pos = begin;
+            auto cursor = [&] { return make_cursor(to_key(*pos)); };
+            for (uint32_t size = 0; pos != stop && (page_end || size < *limit); ++pos, ++size)
+            {
+               if (!scanned)
+                  count_rows_scanned();
+               count_edge_emitted();
+               if (!f(edge_type{to_node(*pos), cursor}))
+                  return;
+            }
+            scanned = true;
+            page_end = pos;
+         }
+
+         connection_page<edge_type>* copy_to(void* storage) const override
+         {
+            return new (storage) page(*this);
+         }
+      };
+
+      Connection result;
+      result.set_page(has_previous_page, page{it, end, rangeEnd, limit, scanned, to_key, to_node});
       return result;
    }
 }  // namespace clchain
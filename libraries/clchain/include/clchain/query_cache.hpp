@@ -0,0 +1,175 @@
+#pragma once
+
+#include <clchain/sync.hpp>
+#include <eosio/fixed_bytes.hpp>
+#include <eosio/reflection.hpp>
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace clchain
+{
+   // Collapses whitespace, commas, and comments outside of string literals, so
+   // queries which only differ in formatting share a cache entry
+   inline std::string normalize_query(std::string_view query)
+   {
+      std::string result;
+      result.reserve(query.size());
+      bool in_string = false;
+      bool pending_space = false;
+      for (size_t i = 0; i < query.size(); ++i)
+      {
+         char ch = query[i];
+         if (in_string)
+         {
+            result.push_back(ch);
+            if (ch == '\\' && i + 1 < query.size())
+               result.push_back(query[++i]);
+            else if (ch == '"')
+               in_string = false;
+         }
+         else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r' || ch == ',')
+            pending_space = !result.empty();
+         else if (ch == '#')
+         {
+            // Comments run to the end of the line, like in the lexer
+            while (i + 1 < query.size() && query[i + 1] != '\n' && query[i + 1] != '\r')
+               ++i;
+            pending_space = !result.empty();
+         }
+         else
+         {
+            if (pending_space)
+               result.push_back(' ');
+            pending_space = false;
+            result.push_back(ch);
+            in_string = ch == '"';
+         }
+      }
+      return result;
+   }
+
+   struct query_cache_stats
+   {
+      uint32_t hits = 0;
+      uint32_t misses = 0;
+      uint32_t entries = 0;
+      uint32_t bytes = 0;
+      uint32_t max_bytes = 0;
+   };
+   EOSIO_REFLECT(query_cache_stats, hits, misses, entries, bytes, max_bytes)
+
+   // LRU cache of query results. Entries are only valid for the state they
+   // were produced from; the cache empties itself when the head id changes,
+   // and owners must call clear() after any other state change. max_bytes
+   // bounds the total size of keys and results; 0 disables the cache. All
+   // members may be called from multiple threads.
+   class query_cache
+   {
+     public:
+      explicit query_cache(uint32_t max_bytes = 16 * 1024 * 1024) : max_bytes{max_bytes} {}
+
+      void clear()
+      {
+         lock_guard<mutex> lock{m};
+         clear_entries();
+      }
+
+      void set_max_bytes(uint32_t value)
+      {
+         lock_guard<mutex> lock{m};
+         max_bytes = value;
+         shrink(max_bytes);
+      }
+
+      // Calls use with the cached result, if any. The result may be evicted
+      // once use returns.
+      template <typename F>
+      bool get(const eosio::checksum256& head, const std::string& key, F&& use)
+      {
+         lock_guard<mutex> lock{m};
+         if (head != this->head)
+         {
+            clear_entries();
+            this->head = head;
+         }
+         auto it = index.find(key);
+         if (it == index.end())
+         {
+            ++misses;
+            return false;
+         }
+         ++hits;
+         entries.splice(entries.begin(), entries, it->second);
+         use(it->second->value);
+         return true;
+      }
+
+      // Must follow a get() with the same head which missed
+      void put(std::string key, std::string value)
+      {
+         lock_guard<mutex> lock{m};
+         if (index.count(key))
+            return;
+         auto size = entry_size(key, value);
+         if (size > max_bytes)
+            return;
+         shrink(max_bytes - size);
+         entries.push_front({std::move(key), std::move(value)});
+         index[entries.front().key] = entries.begin();
+         bytes += size;
+      }
+
+      query_cache_stats stats() const
+      {
+         lock_guard<mutex> lock{m};
+         return {
+             .hits = hits,
+             .misses = misses,
+             .entries = (uint32_t)entries.size(),
+             .bytes = bytes,
+             .max_bytes = max_bytes,
+         };
+      }
+
+     private:
+      void clear_entries()
+      {
+         index.clear();
+         entries.clear();
+         bytes = 0;
+      }
+
+      struct entry
+      {
+         std::string key;
+         std::string value;
+      };
+
+      static uint32_t entry_size(const std::string& key, const std::string& value)
+      {
+         return key.size() + value.size() + sizeof(entry);
+      }
+
+      void shrink(uint32_t target)
+      {
+         while (bytes > target && !entries.empty())
+         {
+            auto& e = entries.back();
+            bytes -= entry_size(e.key, e.value);
+            index.erase(e.key);
+            entries.pop_back();
+         }
+      }
+
+      mutable mutex m;
+      eosio::checksum256 head;
+      std::list<entry> entries;
+      std::unordered_map<std::string_view, std::list<entry>::iterator> index;
+      uint32_t max_bytes;
+      uint32_t bytes = 0;
+      uint32_t hits = 0;
+      uint32_t misses = 0;
+   };
+}  // namespace clchain
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <chrono>
+#include <clchain/sync.hpp>
+#include <eosio/reflection.hpp>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace clchain
+{
+   // Work done on behalf of one top-level field, summed over every query
+   // which selected it
+   struct query_field_stats
+   {
+      std::string field;
+      uint32_t calls = 0;
+      uint32_t index_seeks = 0;
+      uint32_t rows_scanned = 0;
+      uint32_t edges_emitted = 0;
+      uint64_t output_bytes = 0;
+      uint64_t time_us = 0;
+   };
+   EOSIO_REFLECT(query_field_stats,
+                 field,
+                 calls,
+                 index_seeks,
+                 rows_scanned,
+                 edges_emitted,
+                 output_bytes,
+                 time_us)
+
+   struct query_stats_report
+   {
+      uint32_t queries = 0;
+      std::vector<query_field_stats> fields;
+   };
+   EOSIO_REFLECT(query_stats_report, queries, fields)
+
+   // Opt-in query instrumentation. While disabled, the only cost is a null
+   // check at each counted event. Each thread counts into its own
+   // query_field_stats and adds it to the totals when the field completes.
+   // enabled must not change while queries are running.
+   struct query_stats
+   {
+      bool enabled = false;
+
+      void count_query()
+      {
+         lock_guard<mutex> lock{m};
+         ++queries;
+      }
+
+      void add(const query_field_stats& stats)
+      {
+         lock_guard<mutex> lock{m};
+         auto it = fields.find(stats.field);
+         if (it == fields.end())
+            it = fields.emplace(stats.field, query_field_stats{stats.field}).first;
+         auto& total = it->second;
+         total.calls += stats.calls;
+         total.index_seeks += stats.index_seeks;
+         total.rows_scanned += stats.rows_scanned;
+         total.edges_emitted += stats.edges_emitted;
+         total.output_bytes += stats.output_bytes;
+         total.time_us += stats.time_us;
+      }
+
+      void clear()
+      {
+         lock_guard<mutex> lock{m};
+         queries = 0;
+         fields.clear();
+      }
+
+      query_stats_report report() const
+      {
+         lock_guard<mutex> lock{m};
+         query_stats_report result{queries};
+         for (auto& [_, stats] : fields)
+            result.fields.push_back(stats);
+         return result;
+      }
+
+     private:
+      mutable mutex m;
+      uint32_t queries = 0;
+      std::map<std::string, query_field_stats, std::less<>> fields;
+   };
+   inline query_stats gql_query_stats;
+
+   // The top-level field this thread is executing, if stats are enabled
+   inline CLCHAIN_THREAD_LOCAL query_field_stats* current_query_field_stats = nullptr;
+
+   inline void count_index_seek()
+   {
+      if (auto* stats = current_query_field_stats)
+         ++stats->index_seeks;
+   }
+
+   inline void count_rows_scanned(uint32_t n = 1)
+   {
+      if (auto* stats = current_query_field_stats)
+         stats->rows_scanned += n;
+   }
+
+   inline void count_edge_emitted()
+   {
+      if (auto* stats = current_query_field_stats)
+         ++stats->edges_emitted;
+   }
+
+   template <typename S>
+   auto gql_output_size(const S& stream, int) -> decltype(stream.data.size())
+   {
+      return stream.data.size();
+   }
+
+   template <typename S>
+   size_t gql_output_size(const S&, long)
+   {
+      return 0;
+   }
+
+   // Attributes the work done during its lifetime to a top-level field.
+   // Does nothing unless stats are enabled and no other field is active.
+   template <typename OS>
+   class query_field_scope
+   {
+     public:
+      query_field_scope(std::string_view field, const OS& output_stream)
+          : output_stream{output_stream}
+      {
+         if (!gql_query_stats.enabled || current_query_field_stats)
+            return;
+         stats.field = field;
+         stats.calls = 1;
+         current_query_field_stats = &stats;
+         active = true;
+         start_size = gql_output_size(output_stream, 0);
+         start_time = std::chrono::steady_clock::now();
+      }
+
+      ~query_field_scope()
+      {
+         if (!active)
+            return;
+         stats.output_bytes = gql_output_size(output_stream, 0) - start_size;
+         stats.time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+                             std::chrono::steady_clock::now() - start_time)
+                             .count();
+         current_query_field_stats = nullptr;
+         gql_query_stats.add(stats);
+      }
+
+      query_field_scope(const query_field_scope&) = delete;
+      query_field_scope& operator=(const query_field_scope&) = delete;
+
+     private:
+      const OS& output_stream;
+      query_field_stats stats;
+      bool active = false;
+      size_t start_size = 0;
+      std::chrono::steady_clock::time_point start_time;
+   };
+}  // namespace clchain
@@ -0,0 +1,106 @@
+#pragma once
+
+// Locks for state shared between threads in native builds. wasm builds are
+// single-threaded and have no <mutex>, so the locks do nothing there.
+
+#ifdef __wasm__
+
+#define CLCHAIN_THREAD_LOCAL
+
+namespace clchain
+{
+   struct mutex
+   {
+      void lock() {}
+      void unlock() {}
+      void lock_shared() {}
+      void unlock_shared() {}
+   };
+   using shared_mutex = mutex;
+
+   template <typename M>
+   struct lock_guard
+   {
+      explicit lock_guard(M&) {}
+   };
+
+   template <typename M>
+   struct shared_lock
+   {
+      explicit shared_lock(M&) {}
+   };
+}  // namespace clchain
+
+#else
+
+#include <condition_variable>
+#include <mutex>
+#include <shared_mutex>
+
+#define CLCHAIN_THREAD_LOCAL thread_local
+
+namespace clchain
+{
+   using mutex = std::mutex;
+
+   // A reader/writer lock which prefers writers: once a writer is waiting,
+   // new readers wait behind it. std::shared_mutex makes no such promise
+   // (glibc's prefers readers), so a steady stream of queries could keep a
+   // writer out indefinitely.
+   class shared_mutex
+   {
+     public:
+      void lock()
+      {
+         std::unique_lock l{m};
+         ++waiting_writers;
+         writer_cv.wait(l, [&] { return !writer && readers == 0; });
+         --waiting_writers;
+         writer = true;
+      }
+
+      void unlock()
+      {
+         {
+            std::lock_guard l{m};
+            writer = false;
+         }
+         writer_cv.notify_one();
+         reader_cv.notify_all();
+      }
+
+      void lock_shared()
+      {
+         std::unique_lock l{m};
+         reader_cv.wait(l, [&] { return !writer && waiting_writers == 0; });
+         ++readers;
+      }
+
+      void unlock_shared()
+      {
+         bool last;
+         {
+            std::lock_guard l{m};
+            last = --readers == 0;
+         }
+         if (last)
+            writer_cv.notify_one();
+      }
+
+     private:
+      std::mutex m;
+      std::condition_variable reader_cv;
+      std::condition_variable writer_cv;
+      unsigned readers = 0;
+      unsigned waiting_writers = 0;
+      bool writer = false;
+   };
+
+   template <typename M>
+   using lock_guard = std::lock_guard<M>;
+
+   template <typename M>
+   using shared_lock = std::shared_lock<M>;
+}  // namespace clchain
+
+#endif
@@ -0,0 +1,801 @@
+#include <chainbase/chainbase.hpp>
+
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/key.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <unistd.h>
+
+int error_count;
+
+void report_error(const char* assertion, const char* file, int line)
+{
+   if (error_count <= 20)
+   {
+      printf("%s:%d: failed %s\n", file, line, assertion);
+   }
+   ++error_count;
+}
+
+#define CHECK(...)                                       \
+   do                                                    \
+   {                                                     \
+      if (__VA_ARGS__)                                   \
+      {                                                  \
+      }                                                  \
+      else                                               \
+      {                                                  \
+         report_error(#__VA_ARGS__, __FILE__, __LINE__); \
+      }                                                  \
+   } while (0)
+
+template <typename F>
+bool throws(F&& f)
+{
+   try
+   {
+      f();
+   }
+   catch (std::exception&)
+   {
+      return true;
+   }
+   return false;
+}
+
+struct by_id;
+struct by_key;
+struct by_key_hash;
+struct by_value;
+
+template <typename T, typename... Indexes>
+using mic = boost::
+    multi_index_container<T, boost::multi_index::indexed_by<Indexes...>, chainbase::allocator<T>>;
+
+template <typename T>
+using ordered_by_id = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_id>,
+    boost::multi_index::key<&T::id>>;
+
+template <typename T>
+using ordered_by_key = boost::multi_index::ordered_unique<  //
+    boost::multi_index::tag<by_key>,
+    boost::multi_index::key<&T::key>>;
+
+template <typename T>
+using ordered_by_value = boost::multi_index::ordered_non_unique<  //
+    boost::multi_index::tag<by_value>,
+    boost::multi_index::key<&T::value>>;
+
+// Maps keys that differ by a multiple of 8 to the same hash
+struct weak_hash
+{
+   std::size_t operator()(uint64_t key) const { return key & 7; }
+};
+
+template <typename T, typename Hash>
+using hashed_by_key = boost::multi_index::hashed_unique<  //
+    boost::multi_index::tag<by_key_hash>,
+    boost::multi_index::key<&T::key>,
+    Hash>;
+
+enum tables
+{
+   row_table,
+};
+
+struct row : public chainbase::object<row_table, row>
+{
+   CHAINBASE_DEFAULT_CONSTRUCTOR(row)
+
+   id_type id;
+   uint64_t key = 0;
+   uint64_t value = 0;
+};
+using row_index = chainbase::generic_index<mic<row, ordered_by_id<row>, ordered_by_key<row>>>;
+
+using non_unique_row_index = chainbase::generic_index<
+    mic<row, ordered_by_id<row>, ordered_by_key<row>, ordered_by_value<row>>>;
+
+using mapped_rows = chainbase::mapped_multi_index_container<
+    row,
+    boost::multi_index::indexed_by<ordered_by_id<row>, ordered_by_key<row>, ordered_by_value<row>>>;
+
+template <typename Hash>
+using hashed_row_index =
+    chainbase::generic_index<mic<row, ordered_by_id<row>, hashed_by_key<row, Hash>>>;
+
+template <typename Index>
+const auto& add_row(Index& t, uint64_t key, uint64_t value = 0)
+{
+   return t.emplace([&](auto& r) {
+      r.key = key;
+      r.value = value;
+   });
+}
+
+void test_pool_reuse()
+{
+   row_index t;
+   auto& resource = t.get_allocator().get_resource();
+
+   // A freed node is handed to the next allocation
+   auto* a = &add_row(t, 1);
+   CHECK(resource.blocks_in_use() == 1);
+   t.remove(*a);
+   CHECK(resource.blocks_in_use() == 0);
+   auto* b = &add_row(t, 2);
+   CHECK(b == a);
+
+   // Undo frees the nodes created by the session and the modified row's old value
+   const row* c;
+   {
+      auto session = t.start_undo_session(true);
+      c = &add_row(t, 3);
+      t.modify(*b, [](auto& r) { r.value = 7; });
+      CHECK(resource.blocks_in_use() == 3);
+   }
+   CHECK(resource.blocks_in_use() == 1);
+   CHECK(t.size() == 1 && b->value == 0);
+   CHECK(&add_row(t, 4) == c);
+   t.remove(*c);
+
+   // Squash keeps the removed row until the merged session is undone
+   {
+      auto s1 = t.start_undo_session(true);
+      t.remove(*b);
+      auto s2 = t.start_undo_session(true);
+      add_row(t, 5);
+      s2.squash();
+      CHECK(resource.blocks_in_use() == 2);
+      s1.undo();
+   }
+   CHECK(resource.blocks_in_use() == 1);
+   CHECK(t.find(b->id) == b);
+
+   // Commit releases the removed row
+   {
+      auto session = t.start_undo_session(true);
+      t.remove(*b);
+      session.push();
+   }
+   CHECK(resource.blocks_in_use() == 1);
+   t.commit(t.revision());
+   CHECK(resource.blocks_in_use() == 0);
+}
+
+void test_pool_release()
+{
+   row_index t;
+   auto& resource = t.get_allocator().get_resource();
+   add_row(t, 0);
+   {
+      auto session = t.start_undo_session(true);
+      t.modify(*t.begin(), [](auto& r) { r.value = 1; });
+      session.push();
+   }
+   t.commit(t.revision());
+   auto baseline = resource.reserved_bytes();
+
+   for (uint64_t i = 1; i < 10000; ++i)
+      add_row(t, i);
+   {
+      auto session = t.start_undo_session(true);
+      for (auto& r : t)
+         t.modify(r, [](auto& r) { ++r.value; });
+      session.push();
+   }
+   CHECK(resource.reserved_bytes() > baseline);
+
+   // Once an index is empty, all but one slab per pool is given back
+   {
+      auto session = t.start_undo_session(true);
+      while (!t.empty())
+         t.remove(*t.begin());
+      session.push();
+   }
+   t.commit(t.revision());
+   CHECK(resource.blocks_in_use() == 0);
+   CHECK(resource.reserved_bytes() == baseline);
+}
+
+void test_separate_pools()
+{
+   row_index t1;
+   row_index t2;
+   CHECK(t1.get_allocator() != t2.get_allocator());
+   CHECK(t1.get_allocator() == t1.get_allocator());
+   add_row(t1, 1);
+   add_row(t1, 2);
+   add_row(t2, 1);
+   CHECK(t1.get_allocator().get_resource().blocks_in_use() == 2);
+   CHECK(t2.get_allocator().get_resource().blocks_in_use() == 1);
+}
+
+template <typename Index>
+const row* find_key(const Index& t, uint64_t key)
+{
+   auto& idx = t.template get<by_key_hash>();
+   auto it = idx.find(key);
+   if (it == idx.end())
+      return nullptr;
+   return &*it;
+}
+
+// (id, key, value) of each row, in id order
+template <typename Index>
+std::vector<std::tuple<int64_t, uint64_t, uint64_t>> contents(const Index& t)
+{
+   std::vector<std::tuple<int64_t, uint64_t, uint64_t>> result;
+   for (auto& r : t)
+      result.emplace_back(r.id._id, r.key, r.value);
+   return result;
+}
+
+// Every row is reachable through the hashed index by its key, exactly once
+template <typename Index>
+bool hashed_consistent(const Index& t)
+{
+   auto& idx = t.template get<by_key_hash>();
+   if (idx.size() != t.size())
+      return false;
+   std::set<const row*> seen;
+   for (auto& r : idx)
+      if (!seen.insert(&r).second)
+         return false;
+   if (seen.size() != t.size())
+      return false;
+   for (auto& r : t)
+      if (find_key(t, r.key) != &r)
+         return false;
+   return true;
+}
+
+template <typename Hash>
+void test_hashed_conflicts()
+{
+   hashed_row_index<Hash> t;
+   for (uint64_t i = 1; i <= 20; ++i)
+      add_row(t, i);
+   auto find = [&](uint64_t key) { return find_key(t, key); };
+
+   // A conflicting emplace leaves the index unchanged; a colliding hash doesn't conflict
+   auto before = contents(t);
+   CHECK(throws([&] { add_row(t, 5); }));
+   CHECK(contents(t) == before);
+   CHECK(hashed_consistent(t));
+   auto& r13 = *find(13);
+   t.remove(r13);
+   auto& r29 = add_row(t, 29);
+   CHECK(find(29) == &r29 && !find(13) && find(5)->key == 5);
+   CHECK(hashed_consistent(t));
+
+   // Outside a session, a conflicting modify removes the row
+   auto* r1 = find(1);
+   CHECK(throws([&] { t.modify(*r1, [](auto& r) { r.key = 2; }); }));
+   CHECK(!find(1) && find(2)->key == 2 && t.size() == 19);
+   CHECK(hashed_consistent(t));
+
+   // Inside a session, it reverts rows which existed before the session and
+   // removes rows created by it; undo restores the rest
+   before = contents(t);
+   {
+      auto session = t.start_undo_session(true);
+      auto* r3 = find(3);
+      t.modify(*find(4), [](auto& r) { r.value = 1; });
+      CHECK(throws([&] { t.modify(*r3, [](auto& r) { r.key = 4; }); }));
+      CHECK(find(3) == r3 && find(4)->value == 1);
+      CHECK(hashed_consistent(t));
+
+      auto& r100 = add_row(t, 100);
+      CHECK(throws([&] { t.modify(r100, [](auto& r) { r.key = 12; }); }));
+      CHECK(!find(100) && find(12)->key == 12);
+      CHECK(hashed_consistent(t));
+
+      // Keys freed by a modify can be taken by the next one
+      t.modify(*find(6), [](auto& r) { r.key = 106; });
+      t.modify(*find(7), [](auto& r) { r.key = 6; });
+      CHECK(!find(7) && find(6)->id._id == 6 && find(106)->id._id == 5);
+      CHECK(hashed_consistent(t));
+   }
+   CHECK(contents(t) == before);
+   CHECK(hashed_consistent(t));
+}
+
+template <typename Hash>
+void test_hashed_undo_squash()
+{
+   hashed_row_index<Hash> t;
+   for (uint64_t i = 0; i < 50; ++i)
+      add_row(t, i);
+   auto find = [&](uint64_t key) { return find_key(t, key); };
+   auto change = [&](uint64_t offset) {
+      for (uint64_t i = offset; i < 50; i += 6)
+         t.modify(*find(i), [](auto& r) { r.key += 1000; });
+      for (uint64_t i = offset + 1; i < 50; i += 6)
+         t.remove(*find(i));
+      for (uint64_t i = 0; i < 10; ++i)
+         add_row(t, 2000 + offset * 100 + i);
+   };
+
+   auto before = contents(t);
+   {
+      auto s1 = t.start_undo_session(true);
+      change(0);
+      auto s2 = t.start_undo_session(true);
+      change(2);
+      CHECK(hashed_consistent(t));
+      s2.squash();
+      CHECK(hashed_consistent(t));
+      CHECK(find(1000) && !find(0) && find(2200) && !find(1));
+   }
+   CHECK(contents(t) == before);
+   CHECK(hashed_consistent(t));
+
+   {
+      auto s1 = t.start_undo_session(true);
+      change(0);
+      auto s2 = t.start_undo_session(true);
+      change(2);
+      s2.squash();
+      s1.push();
+   }
+   auto after = contents(t);
+   t.commit(t.revision());
+   CHECK(contents(t) == after);
+   CHECK(hashed_consistent(t));
+}
+
+template <typename Hash>
+void test_hashed_rehash()
+{
+   hashed_row_index<Hash> t;
+   auto before = contents(t);
+   {
+      auto session = t.start_undo_session(true);
+      for (uint64_t i = 0; i < 5000; ++i)
+      {
+         add_row(t, i * 5);
+         if ((i & (i - 1)) == 0)
+            CHECK(hashed_consistent(t));
+      }
+      CHECK(hashed_consistent(t));
+      CHECK(find_key(t, 4999 * 5));
+      CHECK(!find_key(t, 4999 * 5 + 1));
+   }
+   CHECK(t.empty() && t.template get<by_key_hash>().empty());
+   CHECK(!find_key(t, 0));
+
+   // Buckets don't shrink; the index grows again from where it was
+   for (uint64_t i = 0; i < 5000; ++i)
+      add_row(t, i);
+   CHECK(hashed_consistent(t));
+}
+
+template <typename Hash>
+void test_hashed_find_after_remove()
+{
+   hashed_row_index<Hash> t;
+   for (uint64_t i = 0; i < 64; ++i)
+      add_row(t, i);
+   auto find = [&](uint64_t key) { return find_key(t, key); };
+
+   // 1, 9, 17, ... share a hash under weak_hash
+   t.remove(*find(17));
+   CHECK(!find(17) && find(9) && find(25));
+   {
+      auto session = t.start_undo_session(true);
+      t.remove(*find(9));
+      t.remove(*find(1));
+      CHECK(!find(9) && !find(1) && find(25) && find(33));
+      CHECK(hashed_consistent(t));
+   }
+   CHECK(find(9) && find(1) && !find(17));
+   CHECK(hashed_consistent(t));
+
+   while (!t.empty())
+      t.remove(*t.begin());
+   CHECK(!find(1) && t.template get<by_key_hash>().begin() == t.template get<by_key_hash>().end());
+}
+
+template <typename Hash>
+void test_hashed()
+{
+   test_hashed_conflicts<Hash>();
+   test_hashed_undo_squash<Hash>();
+   test_hashed_rehash<Hash>();
+   test_hashed_find_after_remove<Hash>();
+}
+
+template <typename It>
+std::vector<int64_t> ids(It begin, It end)
+{
+   std::vector<int64_t> result;
+   for (; begin != end; ++begin)
+      result.push_back(begin->id._id);
+   return result;
+}
+
+// Checks the by_value index against the rows in id order
+template <typename Index>
+bool non_unique_consistent(const Index& t)
+{
+   std::map<uint64_t, std::vector<int64_t>> expected;
+   for (auto& r : t)
+      expected[r.value].push_back(r.id._id);
+   std::vector<int64_t> all;
+   for (auto& [value, value_ids] : expected)
+      all.insert(all.end(), value_ids.begin(), value_ids.end());
+
+   auto& idx = t.template get<by_value>();
+   if (idx.size() != t.size() || ids(idx.begin(), idx.end()) != all)
+      return false;
+   for (uint64_t value = 0; value <= 6; ++value)
+   {
+      auto& value_ids = expected[value];
+      auto lower = idx.lower_bound(value);
+      auto upper = idx.upper_bound(value);
+      auto [first, last] = idx.equal_range(value);
+      if (ids(lower, upper) != value_ids || first != lower || last != upper)
+         return false;
+      if (lower != idx.end() && lower->value < value)
+         return false;
+      if (upper != idx.end() && upper->value <= value)
+         return false;
+      auto found = idx.find(value);
+      if (value_ids.empty() ? found != idx.end() : found != lower)
+         return false;
+   }
+   return true;
+}
+
+void test_non_unique()
+{
+   non_unique_row_index t;
+   for (uint64_t i = 0; i < 40; ++i)
+      add_row(t, i, i % 4);
+   CHECK(non_unique_consistent(t));
+   auto& idx = t.get<by_value>();
+   CHECK(ids(idx.lower_bound(2), idx.upper_bound(2)) ==
+         std::vector<int64_t>{2, 6, 10, 14, 18, 22, 26, 30, 34, 38});
+
+   // A modified row takes its place among equal keys by id, not by the order of changes
+   auto before = contents(t);
+   {
+      auto session = t.start_undo_session(true);
+      t.modify(*t.find(chainbase::oid<row>(13)), [](auto& r) { r.value = 2; });
+      t.modify(*t.find(chainbase::oid<row>(1)), [](auto& r) { r.value = 2; });
+      t.modify(*t.find(chainbase::oid<row>(39)), [](auto& r) { r.value = 2; });
+      t.modify(*t.find(chainbase::oid<row>(6)), [](auto& r) { r.value = 5; });
+      CHECK(ids(idx.lower_bound(2), idx.upper_bound(2)) ==
+            std::vector<int64_t>{1, 2, 10, 13, 14, 18, 22, 26, 30, 34, 38, 39});
+      CHECK(ids(idx.lower_bound(4), idx.upper_bound(5)) == std::vector<int64_t>{6});
+      CHECK(idx.lower_bound(4) == idx.upper_bound(3) && idx.equal_range(4).first->id._id == 6);
+      CHECK(non_unique_consistent(t));
+
+      t.remove(*t.find(chainbase::oid<row>(10)));
+      add_row(t, 100, 2);
+      CHECK(ids(idx.lower_bound(2), idx.upper_bound(2)).back() == 40);
+      CHECK(non_unique_consistent(t));
+
+      // Duplicate keys don't conflict in a non-unique index; the unique index still does
+      CHECK(throws([&] { t.modify(*t.find(chainbase::oid<row>(2)), [](auto& r) { r.key = 3; }); }));
+      CHECK(t.find(chainbase::oid<row>(2))->key == 2);
+      CHECK(non_unique_consistent(t));
+   }
+   CHECK(contents(t) == before);
+   CHECK(non_unique_consistent(t));
+
+   // Squash and commit keep the order
+   {
+      auto s1 = t.start_undo_session(true);
+      t.modify(*t.find(chainbase::oid<row>(0)), [](auto& r) { r.value = 3; });
+      auto s2 = t.start_undo_session(true);
+      t.modify(*t.find(chainbase::oid<row>(35)), [](auto& r) { r.value = 0; });
+      s2.squash();
+      s1.push();
+   }
+   t.commit(t.revision());
+   CHECK(ids(idx.lower_bound(3), idx.upper_bound(3)).front() == 0);
+   CHECK(ids(idx.lower_bound(0), idx.upper_bound(0)) ==
+         std::vector<int64_t>{4, 8, 12, 16, 20, 24, 28, 32, 35, 36});
+   CHECK(non_unique_consistent(t));
+}
+
+// Loads rows with the given ids, keys, and values
+template <typename Index>
+void bulk_load_rows(Index& t, const std::vector<std::tuple<int64_t, uint64_t, uint64_t>>& rows)
+{
+   std::size_t i = 0;
+   t.bulk_load(rows.size(), [&](auto& r) {
+      auto [id, key, value] = rows[i++];
+      r.id = id;
+      r.key = key;
+      r.value = value;
+   });
+}
+
+void test_bulk_load()
+{
+   std::vector<std::tuple<int64_t, uint64_t, uint64_t>> rows;
+   for (int64_t i = 0; i < 1000; ++i)
+      rows.emplace_back(i * 2, uint64_t(i * 7919 % 1000), uint64_t(i % 3));
+   auto sorted = rows;
+   std::reverse(rows.begin(), rows.end());
+
+   // Rows may arrive in any order; next_id follows the largest id
+   {
+      non_unique_row_index t;
+      bulk_load_rows(t, rows);
+      CHECK(contents(t) == sorted);
+      CHECK(t.next_id()._id == 1999);
+      CHECK(non_unique_consistent(t));
+      auto& by_key_idx = t.get<by_key>();
+      CHECK(std::is_sorted(by_key_idx.begin(), by_key_idx.end(),
+                           [](auto& a, auto& b) { return a.key < b.key; }));
+      CHECK(by_key_idx.size() == 1000 && by_key_idx.find(uint64_t(500))->id._id == 1000);
+      CHECK(add_row(t, 5000).id._id == 1999);
+      CHECK(non_unique_consistent(t));
+   }
+   {
+      hashed_row_index<weak_hash> t;
+      bulk_load_rows(t, rows);
+      CHECK(contents(t) == sorted);
+      CHECK(hashed_consistent(t));
+   }
+   {
+      row_index t;
+      bulk_load_rows(t, {});
+      CHECK(t.empty() && t.next_id()._id == 0);
+   }
+
+   // The index must be empty, with no undo stack
+   {
+      row_index t;
+      add_row(t, 1);
+      auto before = contents(t);
+      CHECK(throws([&] { bulk_load_rows(t, {{5, 5, 0}}); }));
+      CHECK(contents(t) == before);
+
+      t.remove(*t.begin());
+      auto session = t.start_undo_session(true);
+      CHECK(throws([&] { bulk_load_rows(t, {{5, 5, 0}}); }));
+      CHECK(t.empty());
+   }
+
+   // Failures leave the index empty and release every node
+   auto fails = [&](auto&& t, const std::vector<std::tuple<int64_t, uint64_t, uint64_t>>& rows) {
+      auto& resource = t.get_allocator().get_resource();
+      bool threw = throws([&] { bulk_load_rows(t, rows); });
+      return threw && t.empty() && resource.blocks_in_use() == 0;
+   };
+   auto dup_key = sorted;
+   std::get<1>(dup_key[700]) = std::get<1>(dup_key[300]);
+   auto dup_id = sorted;
+   std::get<0>(dup_id[700]) = std::get<0>(dup_id[300]);
+   CHECK(fails(non_unique_row_index{}, dup_key));
+   CHECK(fails(hashed_row_index<weak_hash>{}, dup_key));
+   CHECK(fails(hashed_row_index<std::hash<uint64_t>>{}, dup_key));
+   CHECK(fails(non_unique_row_index{}, dup_id));
+   {
+      row_index t;
+      t.remove(add_row(t, 1));
+      CHECK(fails(t, sorted));
+      CHECK(t.next_id()._id == 1);
+   }
+   {
+      row_index t;
+      auto& resource = t.get_allocator().get_resource();
+      int count = 0;
+      CHECK(throws([&] {
+         t.bulk_load(100, [&](auto& r) {
+            if (++count == 50)
+               throw std::runtime_error("constructor failed");
+            r.id = count;
+            r.key = count;
+         });
+      }));
+      CHECK(t.empty() && resource.blocks_in_use() == 0);
+   }
+}
+
+struct temp_dir
+{
+   std::filesystem::path path = std::filesystem::temp_directory_path() /
+                                ("chainbase-test-" + std::to_string(getpid()));
+
+   temp_dir() { std::filesystem::create_directories(path); }
+   ~temp_dir() { std::filesystem::remove_all(path); }
+};
+
+template <typename Index>
+std::vector<std::tuple<int64_t, uint64_t, uint64_t>> committed_contents(const Index& t)
+{
+   std::vector<std::tuple<int64_t, uint64_t, uint64_t>> result;
+   for (auto* r : t.committed_rows())
+      result.emplace_back(r->id._id, r->key, r->value);
+   return result;
+}
+
+// committed_rows matches what undo_all restores, and leaves the table alone
+void test_committed_rows()
+{
+   for (uint64_t trial = 0; trial < 50; ++trial)
+   {
+      row_index t, twin;
+      uint64_t seed = trial;
+      auto random = [&](uint64_t n) {
+         seed = seed * 6364136223846793005 + 1442695040888963407;
+         return (seed >> 33) % n;
+      };
+      auto nth = [](auto& t, uint64_t i) -> const row& { return *std::next(t.begin(), i); };
+      uint64_t next_key = 0;
+      for (; next_key < 20; ++next_key)
+      {
+         add_row(t, next_key);
+         add_row(twin, next_key);
+      }
+      for (uint64_t round = 0; round < 200; ++round)
+      {
+         auto op = random(10);
+         if (op < 2)
+         {
+            t.start_undo_session(true).push();
+            twin.start_undo_session(true).push();
+         }
+         else if (op == 2 && t.has_undo_session() && random(2))
+         {
+            t.undo();
+            twin.undo();
+         }
+         else if (op == 3 && t.has_undo_session())
+         {
+            t.squash();
+            twin.squash();
+         }
+         else if (op == 4 && random(4) == 0)
+         {
+            auto revision = t.revision() - random(3);
+            t.commit(revision);
+            twin.commit(revision);
+         }
+         else if (op == 5 && !t.empty())
+         {
+            auto i = random(t.size());
+            t.remove(nth(t, i));
+            twin.remove(nth(twin, i));
+         }
+         else if (op >= 6 && op < 8 && !t.empty())
+         {
+            auto i = random(t.size());
+            auto change = [&](auto& r) {
+               r.value += 1;
+               if (op == 7)
+                  r.key = next_key;
+            };
+            t.modify(nth(t, i), change);
+            twin.modify(nth(twin, i), change);
+            next_key += op == 7;
+         }
+         else
+         {
+            add_row(t, next_key, round);
+            add_row(twin, next_key, round);
+            ++next_key;
+         }
+      }
+
+      auto current = contents(t);
+      auto committed = committed_contents(t);
+      CHECK(contents(t) == current);
+      CHECK(contents(twin) == current);
+      twin.undo_all();
+      CHECK(committed == contents(twin));
+      CHECK(t.committed_next_id() == twin.next_id());
+   }
+}
+
+void test_mapped()
+{
+   temp_dir dir;
+   auto file = dir.path / "db";
+   constexpr std::size_t size = 1024 * 1024;
+
+   // Create, close, and reopen; the undo stack is stored with the rows
+   std::vector<std::tuple<int64_t, uint64_t, uint64_t>> committed;
+   std::vector<std::tuple<int64_t, uint64_t, uint64_t>> pushed;
+   {
+      chainbase::database db(file, size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      CHECK(t.empty());
+      for (uint64_t i = 0; i < 100; ++i)
+         add_row(t, i, i % 7);
+      committed = contents(t);
+
+      auto session = db.start_undo_session(true);
+      t.modify(*t.begin(), [](auto& r) { r.value = 1000; });
+      t.remove(*t.find(chainbase::oid<row>(1)));
+      add_row(t, 500);
+      session.push();
+      pushed = contents(t);
+   }
+   CHECK(std::filesystem::file_size(file) == size);
+   {
+      chainbase::database db(file, size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      CHECK(contents(t) == pushed);
+      CHECK(db.revision() == 1 && t.next_id()._id == 101);
+      CHECK(non_unique_consistent(t));
+      db.undo();
+      CHECK(contents(t) == committed);
+      CHECK(db.revision() == 0);
+   }
+   {
+      chainbase::database db(file, size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      CHECK(contents(t) == committed);
+      CHECK(db.revision() == 0 && t.next_id()._id == 100);
+   }
+
+   // Opening with a larger size grows the file, keeping its contents
+   {
+      chainbase::database db(file, 8 * size);
+      CHECK(std::filesystem::file_size(file) == 8 * size);
+      CHECK(db.free_memory() > 6 * size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      CHECK(contents(t) == committed);
+      for (uint64_t i = 100; i < 30000; ++i)
+         add_row(t, i, i % 7);
+      CHECK(t.size() == 30000);
+      CHECK(non_unique_consistent(t));
+      committed = contents(t);
+   }
+   {
+      chainbase::database db(file, size);
+      CHECK(std::filesystem::file_size(file) == 8 * size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      CHECK(contents(t) == committed);
+   }
+
+   // A file which wasn't closed is rejected unless allow_dirty is set
+   auto crashed = dir.path / "crashed";
+   {
+      chainbase::database db(file, size);
+      auto& t = db.add_mapped_index<mapped_rows>();
+      t.remove(*t.begin());
+      committed = contents(t);
+      db.flush();
+      std::filesystem::copy_file(file, crashed);
+   }
+   CHECK(throws([&] { chainbase::database db(crashed, size); }));
+   {
+      chainbase::database db(crashed, size, true);
+      CHECK(contents(db.add_mapped_index<mapped_rows>()) == committed);
+   }
+   {
+      chainbase::database db(crashed, size);
+      CHECK(contents(db.add_mapped_index<mapped_rows>()) == committed);
+   }
+}
+
+int main()
+{
+   test_pool_reuse();
+   test_pool_release();
+   test_separate_pools();
+   test_hashed<weak_hash>();
+   test_hashed<std::hash<uint64_t>>();
+   test_non_unique();
+   test_bulk_load();
+   test_committed_rows();
+   test_mapped();
+   if (error_count)
+      return 1;
+}
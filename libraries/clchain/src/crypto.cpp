@@ -1,5 +1,6 @@
 #include <clchain/crypto.hpp>
-
+#include <eosio/check.hpp>
+#include <openssl/evp.h>
 #include <openssl/sha.h>
 
 namespace clchain
@@ -10,4 +11,35 @@ namespace clchain
       SHA256((const unsigned char*)data, length, result.data());
       return result;
    }
+
+   sha256_hasher::sha256_hasher() : ctx(EVP_MD_CTX_new())
+   {
+      if (!ctx || !EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr))
+      {
+         EVP_MD_CTX_free(ctx);
+         eosio::check(false, "sha256 init failed");
+      }
+   }
+
+   sha256_hasher::~sha256_hasher() { EVP_MD_CTX_free(ctx); }
+
+   void sha256_hasher::flush()
+   {
+      update_ctx(buffer, buffered);
+      buffered = 0;
+   }
+
+   void sha256_hasher::update_ctx(const char* data, size_t length)
+   {
+      if (length)
+         EVP_DigestUpdate(ctx, data, length);
+   }
+
+   eosio::checksum256 sha256_hasher::finish()
+   {
+      flush();
+      std::array<unsigned char, 256 / 8> result;
+      EVP_DigestFinal_ex(ctx, result.data(), nullptr);
+      return result;
+   }
 }  // namespace clchain
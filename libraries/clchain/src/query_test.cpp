@@ -0,0 +1,141 @@
+#include <clchain/graphql_connection.hpp>
+#include <clchain/query_cache.hpp>
+
+#include <cstdio>
+#include <map>
+
+int error_count;
+
+void report_error(const char* assertion, const char* file, int line)
+{
+   if (error_count <= 20)
+   {
+      printf("%s:%d: failed %s\n", file, line, assertion);
+   }
+   ++error_count;
+}
+
+#define CHECK(...)                                       \
+   do                                                    \
+   {                                                     \
+      if (__VA_ARGS__)                                   \
+      {                                                  \
+      }                                                  \
+      else                                               \
+      {                                                  \
+         report_error(#__VA_ARGS__, __FILE__, __LINE__); \
+      }                                                  \
+   } while (0)
+
+void test_normalize_query()
+{
+   using clchain::normalize_query;
+   CHECK(normalize_query("  {\n  a,b  c }\n") == "{ a b c }");
+   CHECK(normalize_query("{a(s:\"x  ,# y\")}") == "{a(s:\"x  ,# y\")}");
+   CHECK(normalize_query("{a(s:\"\\\" #\")}") == "{a(s:\"\\\" #\")}");
+
+   // Comments end at the line break; they must not swallow what follows it
+   CHECK(normalize_query("{ x #\n y }") == "{ x y }");
+   CHECK(normalize_query("{ x # y\n}") == "{ x }");
+   CHECK(normalize_query("{ x #\n y }") != normalize_query("{ x # y\n}"));
+   CHECK(normalize_query("{ x # y\r\n z }") == "{ x z }");
+   CHECK(normalize_query("# leading\n{x}# trailing") == "{x}");
+}
+
+struct Item
+{
+   uint32_t id;
+};
+EOSIO_REFLECT2(Item, id)
+
+constexpr const char ItemConnection_name[] = "ItemConnection";
+constexpr const char ItemEdge_name[] = "ItemEdge";
+using ItemConnection =
+    clchain::Connection<clchain::ConnectionConfig<Item, ItemConnection_name, ItemEdge_name>>;
+
+std::map<uint32_t, Item> items;
+
+struct Query
+{
+   ItemConnection items(std::optional<uint32_t> gt,
+                        std::optional<uint32_t> first,
+                        std::optional<uint32_t> last) const
+   {
+      return clchain::make_connection<ItemConnection, uint32_t>(
+          gt, std::nullopt, std::nullopt, std::nullopt, first, last, std::nullopt, std::nullopt,
+          ::items, [](auto& item) { return item.first; }, [](auto& item) { return item.second; },
+          [](auto& items, auto key) { return items.lower_bound(key); },
+          [](auto& items, auto key) { return items.upper_bound(key); });
+   }
+};
+EOSIO_REFLECT2(Query, method(items, "gt", "first", "last"))
+
+clchain::query_field_stats run_with_stats(std::string_view query, std::string* output = nullptr)
+{
+   auto& stats = clchain::gql_query_stats;
+   stats.clear();
+   stats.enabled = true;
+   auto result = clchain::gql_query(Query{}, query, "");
+   if (output)
+      *output = std::move(result);
+   stats.enabled = false;
+   auto report = stats.report();
+   CHECK(report.queries == 1);
+   CHECK(report.fields.size() == 1);
+   return report.fields.empty() ? clchain::query_field_stats{} : report.fields[0];
+}
+
+// Each row the connection walks is counted once, whether it's walked to find
+// the page or while writing edges
+void test_connection_stats()
+{
+   for (uint32_t i = 0; i < 10; ++i)
+      items[i] = {i};
+
+   auto first = run_with_stats("{items(first:3){edges{node{id}}}}");
+   CHECK(first.field == "items");
+   CHECK(first.calls == 1);
+   CHECK(first.index_seeks == 0);
+   CHECK(first.rows_scanned == 3);
+   CHECK(first.edges_emitted == 3);
+
+   auto last = run_with_stats("{items(gt:2,last:2){edges{node{id}}}}");
+   CHECK(last.index_seeks == 1);
+   CHECK(last.rows_scanned == 2);
+   CHECK(last.edges_emitted == 2);
+
+   auto all = run_with_stats("{items{edges{node{id}}}}");
+   CHECK(all.rows_scanned == 10);
+   CHECK(all.edges_emitted == 10);
+
+   auto no_edges = run_with_stats("{items(first:4){pageInfo{hasNextPage}}}");
+   CHECK(no_edges.rows_scanned == 4);
+   CHECK(no_edges.edges_emitted == 0);
+
+   // Writing the edges finds the end of the page; pageInfo reuses it
+   std::string output;
+   auto both = run_with_stats(
+       "{items(first:3){edges{cursor} pageInfo{hasNextPage startCursor endCursor}}}", &output);
+   CHECK(both.rows_scanned == 3);
+   CHECK(both.edges_emitted == 3);
+   CHECK(output ==
+         R"({"data":{"items":{"edges":[{"cursor":"00000000"},{"cursor":"01000000"},)"
+         R"({"cursor":"02000000"}],"pageInfo":{"hasNextPage":true,)"
+         R"("startCursor":"00000000","endCursor":"02000000"}}}})");
+
+   // So does pageInfo when it comes first
+   auto info_first = run_with_stats("{items(first:3){pageInfo{endCursor} edges{cursor}}}");
+   CHECK(info_first.rows_scanned == 3);
+   CHECK(info_first.edges_emitted == 3);
+
+   auto start_only = run_with_stats("{items(first:3){pageInfo{startCursor}}}");
+   CHECK(start_only.rows_scanned == 0);
+}
+
+int main()
+{
+   test_normalize_query();
+   test_connection_stats();
+   if (error_count)
+      return 1;
+}
@@ -0,0 +1,12 @@
+#include <wasi/api.h>
+
+extern "C" __wasi_errno_t __wasi_clock_time_get(__wasi_clockid_t id,
+                                                __wasi_timestamp_t precision,
+                                                __wasi_timestamp_t* time)
+    __attribute__((__import_module__("wasi_snapshot_preview1"), __import_name__("clock_time_get")))
+{
+   // Milliseconds as a double, which hosts can supply without BigInt
+   [[clang::import_module("clchain"), clang::import_name("now")]] double import_now();
+   *time = import_now() * 1'000'000;
+   return __WASI_ERRNO_SUCCESS;
+}
@@ -95,6 +95,18 @@ export const subchainConfig = {
     atomicMarket: process.env.SUBCHAIN_AA_MARKET_CONTRACT || "atomicmarket",
     wasmFile: process.env.SUBCHAIN_WASM || "../../build/eden-micro-chain.wasm",
     stateFile: process.env.SUBCHAIN_STATE || "state",
+    snapshotFile: process.env.SUBCHAIN_SNAPSHOT || "",
+    snapshotInterval:
+        "SUBCHAIN_SNAPSHOT_INTERVAL" in process.env
+            ? +(process.env.SUBCHAIN_SNAPSHOT_INTERVAL as any)
+            : 60,
+    queryCacheSize:
+        "SUBCHAIN_QUERY_CACHE_SIZE" in process.env
+            ? +(process.env.SUBCHAIN_QUERY_CACHE_SIZE as any)
+            : undefined,
+    defaultPageSize: +(process.env.SUBCHAIN_DEFAULT_PAGE_SIZE as any) || 0,
+    maxPageSize: +(process.env.SUBCHAIN_MAX_PAGE_SIZE as any) || 0,
+    queryStats: "SUBCHAIN_QUERY_STATS" in process.env,
     receiver:
         SubchainReceivers[
             (process.env.SUBCHAIN_RECEIVER ||
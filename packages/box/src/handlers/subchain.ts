@@ -23,6 +23,21 @@ subchainHandler.get("/state", (req, res) => {
     res.sendFile(path.resolve("./state"));
 });
 
+subchainHandler.get("/query-stats", (req, res) => {
+    if (!subchainConfig.queryStats || !storage.blocksWasm)
+        return res.status(404).send("404");
+    res.json(storage.blocksWasm.getQueryStats());
+});
+
+subchainHandler.get("/memory-stats", (req, res) => {
+    if (!storage.blocksWasm || !storage.stateWasm)
+        return res.status(404).send("404");
+    res.json({
+        blocks: storage.blocksWasm.getMemoryStats(),
+        state: storage.stateWasm.getMemoryStats(),
+    });
+});
+
 subchainHandler.use((req, res, next) => {
     res.status(404).send("404");
 });
@@ -8,6 +8,7 @@ export class ShipReceiver {
     storage: Storage;
     wsClient: WebSocket | undefined;
     requestedBlocks = false;
+    pending: Uint8Array[] = [];
 
     constructor(storage: Storage) {
         this.storage = storage;
@@ -60,15 +61,26 @@ export class ShipReceiver {
         if (!this.requestedBlocks) {
             logger.info("Requesting Blocks from SHiP...");
             const request = this.storage.getShipBlocksRequest(
-                shipConfig.firstBlock
+                Math.max(
+                    shipConfig.firstBlock,
+                    this.storage.getEosioIrreversible() + 1
+                )
             );
             this.requestedBlocks = true;
             this.wsClient!.send(request);
             logger.info("Requested Blocks from SHiP!");
         } else {
-            const bytes = new Uint8Array(data as ArrayBuffer);
-            this.storage.pushShipMessage(bytes);
-            this.storage.saveState();
+            // Messages which arrive together (e.g. while catching up) are
+            // pushed to the wasm in a single batch
+            this.pending.push(new Uint8Array(data as ArrayBuffer));
+            if (this.pending.length === 1) setImmediate(() => this.flush());
         }
     }
+
+    flush() {
+        const messages = this.pending;
+        this.pending = [];
+        this.storage.pushShipMessages(messages);
+        this.storage.saveState();
+    }
 }
@@ -8,6 +8,7 @@ export class Storage {
     stateWasm: EdenSubchain | null = null;
     head = 0;
     callbacks: (() => void)[] = [];
+    lastSnapshot = 0;
 
     async instantiate(
         edenAccount: string,
@@ -37,6 +38,19 @@ export class Storage {
                 atomicAccount,
                 atomicmarketAccount
             );
+            this.stateWasm.setReplayMode(true);
+            this.blocksWasm.setConnectionLimits(
+                config.subchainConfig.defaultPageSize,
+                config.subchainConfig.maxPageSize
+            );
+            this.blocksWasm.setQueryStatsEnabled(
+                config.subchainConfig.queryStats
+            );
+            if (config.subchainConfig.queryCacheSize !== undefined)
+                this.blocksWasm.setQueryCacheSize(
+                    config.subchainConfig.queryCacheSize
+                );
+            this.loadSnapshot();
         } catch (e) {
             this.blocksWasm = null;
             this.stateWasm = null;
@@ -68,6 +82,34 @@ export class Storage {
             );
             logger.info(`saved ${config.subchainConfig.stateFile}`);
         });
+        this.saveSnapshot();
+    }
+
+    loadSnapshot() {
+        const file = config.subchainConfig.snapshotFile;
+        if (!file || !fs.existsSync(file)) return;
+        const snapshot = new Uint8Array(fs.readFileSync(file));
+        this.blocksWasm!.loadSnapshot(snapshot);
+        this.stateWasm!.loadSnapshot(snapshot);
+        this.stateWasm!.trimBlocks();
+        this.lastSnapshot = Date.now();
+        logger.info(`loaded ${file}`);
+    }
+
+    saveSnapshot() {
+        const file = config.subchainConfig.snapshotFile;
+        if (!file) return;
+        if (
+            Date.now() - this.lastSnapshot <
+            config.subchainConfig.snapshotInterval * 1000
+        )
+            return;
+        this.protect(() => {
+            fs.writeFileSync(file + ".tmp", this.blocksWasm!.saveSnapshot());
+            fs.renameSync(file + ".tmp", file);
+        });
+        this.lastSnapshot = Date.now();
+        logger.info(`saved ${file}`);
     }
 
     query(q: string): any {
@@ -85,6 +127,11 @@ export class Storage {
             .blockLog.blockByNum.id;
     }
 
+    getEosioIrreversible(): number {
+        const r = this.query("{blockLog{irreversible{eosioBlock{num}}}}");
+        return r.data.blockLog.irreversible?.eosioBlock.num || 0;
+    }
+
     changed() {
         const r = this.query("{blockLog{head{num}}}");
         this.head = r.data.blockLog.head?.num || 0;
@@ -137,4 +184,15 @@ export class Storage {
         this.changed();
         return result;
     }
+
+    pushShipMessages(shipMessages: Uint8Array[]) {
+        const result = this.protect(() => {
+            const result = this.blocksWasm!.pushShipMessages(shipMessages);
+            this.stateWasm!.pushShipMessages(shipMessages);
+            this.stateWasm!.trimBlocks();
+            return result;
+        });
+        this.changed();
+        return result;
+    }
 }
@@ -44,6 +44,7 @@ export class EdenSubchain {
                 for (let i = 0; i < l.length - 1; ++i) console.log(l[i]);
                 this.consoleBuf = l[l.length - 1];
             },
+            now: () => performance.now(),
         },
     };
 
@@ -141,6 +142,15 @@ export class EdenSubchain {
         for (let i = 0; i < u32.length; ++i) dest[i] = u32[i];
     }
 
+    // In replay mode, irreversible eosio blocks skip undo tracking and only
+    // the head block is kept in the log. Only use on instances which trim
+    // their block log anyway.
+    setReplayMode(enabled: boolean) {
+        this.protect(() => {
+            this.exports.setReplayMode(enabled);
+        });
+    }
+
     setIrreversible(eosioIrreversible: number): number {
         return this.protect(() => {
             return this.exports.setIrreversible(eosioIrreversible);
@@ -148,6 +158,7 @@ export class EdenSubchain {
     }
 
     withData<T>(data: Uint8Array, f: (addr: number) => T) {
+        if (!data.length) return f(0);
         const destAddr = this.exports.allocateMemory(data.length);
         if (!destAddr) throw new Error("allocateMemory failed");
         const dest = this.uint8Array(destAddr, data.length);
@@ -160,7 +171,7 @@ export class EdenSubchain {
     pushJsonBlock(jsonBlock: string, eosioIrreversible: number) {
         return this.protect(() => {
             const utf8 = new TextEncoder().encode(jsonBlock);
-            const ok = !this.withData(utf8, (addr) =>
+            const ok = this.withData(utf8, (addr) =>
                 this.exports.addEosioBlockJson(
                     addr,
                     utf8.length,
@@ -201,6 +212,47 @@ export class EdenSubchain {
         });
     }
 
+    // Returns one status per message: true if the block was added
+    pushShipMessages(messages: Uint8Array[]): boolean[] {
+        return this.protect(() => {
+            return this.withData(this.makeBatch(messages), (addr) => {
+                this.exports.pushShipMessages(addr, this.batchSize(messages));
+                return Array.from(this.resultAsUint8Array(), (x) => !!x);
+            });
+        });
+    }
+
+    // Returns one status per block: true if the block was added
+    pushBlocks(blocks: Uint8Array[], eosioIrreversible: number): boolean[] {
+        return this.protect(() => {
+            return this.withData(this.makeBatch(blocks), (addr) => {
+                this.exports.addBlocks(
+                    addr,
+                    this.batchSize(blocks),
+                    eosioIrreversible
+                );
+                return Array.from(this.resultAsUint8Array(), (x) => !!x);
+            });
+        });
+    }
+
+    batchSize(messages: Uint8Array[]) {
+        return messages.reduce((size, m) => size + 4 + m.length, 0);
+    }
+
+    // Each message is prefixed by its size (uint32, little endian)
+    makeBatch(messages: Uint8Array[]) {
+        const batch = new Uint8Array(this.batchSize(messages));
+        const view = new DataView(batch.buffer);
+        let pos = 0;
+        for (const m of messages) {
+            view.setUint32(pos, m.length, true);
+            batch.set(m, pos + 4);
+            pos += 4 + m.length;
+        }
+        return batch;
+    }
+
     trimBlocks() {
         this.protect(() => {
             this.exports.trimBlocks();
@@ -219,6 +271,23 @@ export class EdenSubchain {
         });
     }
 
+    // Keeps the row changes of the last numBlocks reversible blocks for
+    // getBlockDeltas. 0 (the default) disables recording.
+    setBlockDeltaRetention(numBlocks: number) {
+        this.protect(() => {
+            this.exports.setBlockDeltaRetention(numBlocks);
+        });
+    }
+
+    // Binary row changes made by a block; the format is documented with
+    // block_delta in eden-micro-chain.cpp
+    getBlockDeltas(num: number) {
+        return this.protect(() => {
+            if (!this.exports.getBlockDeltas(num)) return null;
+            return new Uint8Array(this.resultAsUint8Array());
+        });
+    }
+
     getBlock(num: number) {
         return this.protect(() => {
             if (!this.exports.getBlock(num)) return null;
@@ -226,6 +295,21 @@ export class EdenSubchain {
         });
     }
 
+    saveSnapshot() {
+        return this.protect(() => {
+            this.exports.saveSnapshot();
+            return new Uint8Array(this.resultAsUint8Array());
+        });
+    }
+
+    loadSnapshot(snapshot: Uint8Array) {
+        this.protect(() => {
+            this.withData(snapshot, (addr) => {
+                this.exports.loadSnapshot(addr, snapshot.length);
+            });
+        });
+    }
+
     getSchema() {
         if (!this.schema.length)
             this.schema = this.decodeStr(
@@ -235,16 +319,215 @@ export class EdenSubchain {
         return this.schema;
     }
 
-    query(q: string) {
+    query(q: string, variables?: any) {
+        const utf8 = new TextEncoder().encode(q);
+        const vars = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
+        return this.protect(() => {
+            return this.withData(utf8, (addr) =>
+                this.withData(vars, (varsAddr) => {
+                    this.exports.query(addr, utf8.length, varsAddr, vars.length);
+                    return JSON.parse(this.resultAsString());
+                })
+            );
+        });
+    }
+
+    // Like query, but returns the result in a compact binary format.
+    // queryBinToJson decodes it; it needs the same query and variables.
+    queryBin(q: string, variables?: any): Uint8Array {
+        const utf8 = new TextEncoder().encode(q);
+        const vars = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
+        return this.protect(() => {
+            return this.withData(utf8, (addr) =>
+                this.withData(vars, (varsAddr) => {
+                    this.exports.queryBin(
+                        addr,
+                        utf8.length,
+                        varsAddr,
+                        vars.length
+                    );
+                    return new Uint8Array(this.resultAsUint8Array());
+                })
+            );
+        });
+    }
+
+    queryBinToJson(q: string, variables: any, data: Uint8Array) {
         const utf8 = new TextEncoder().encode(q);
+        const vars = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
+        return this.protect(() => {
+            return this.withData(utf8, (addr) =>
+                this.withData(vars, (varsAddr) =>
+                    this.withData(data, (dataAddr) => {
+                        this.exports.queryBinToJson(
+                            addr,
+                            utf8.length,
+                            varsAddr,
+                            vars.length,
+                            dataAddr,
+                            data.length
+                        );
+                        return JSON.parse(this.resultAsString());
+                    })
+                )
+            );
+        });
+    }
+
+    // Runs several queries against the same state in one call
+    queryBatch(queries: { query: string; variables?: any }[]): any[] {
+        const encoder = new TextEncoder();
+        const parts = queries.flatMap(({ query, variables }) => [
+            encoder.encode(query),
+            encoder.encode(variables ? JSON.stringify(variables) : ""),
+        ]);
         return this.protect(() => {
-            return this.withData(utf8, (addr) => {
-                this.exports.query(addr, utf8.length, 0, 0);
+            return this.withData(this.makeBatch(parts), (addr) => {
+                const n = this.exports.queryBatch(addr, this.batchSize(parts));
+                const batch = this.resultAsUint8Array();
+                const view = new DataView(
+                    batch.buffer,
+                    batch.byteOffset,
+                    batch.byteLength
+                );
+                const decoder = new TextDecoder();
+                const responses = [];
+                for (let i = 0; i < n; ++i) {
+                    const offset = view.getUint32(4 + i * 8, true);
+                    const size = view.getUint32(8 + i * 8, true);
+                    responses.push(
+                        JSON.parse(
+                            decoder.decode(batch.subarray(offset, offset + size))
+                        )
+                    );
+                }
+                return responses;
+            });
+        });
+    }
+
+    // Parses a query once so it can be executed repeatedly with different
+    // variables. The returned handle must be released with freeQuery.
+    prepareQuery(q: string): number {
+        const utf8 = new TextEncoder().encode(q);
+        return this.protect(() => {
+            return this.withData(utf8, (addr) =>
+                this.exports.prepareQuery(addr, utf8.length)
+            );
+        });
+    }
+
+    executeQuery(handle: number, variables?: any) {
+        const vars = new TextEncoder().encode(
+            variables ? JSON.stringify(variables) : ""
+        );
+        return this.protect(() => {
+            return this.withData(vars, (addr) => {
+                this.exports.executeQuery(handle, addr, vars.length);
                 return JSON.parse(this.resultAsString());
             });
         });
     }
 
+    freeQuery(handle: number) {
+        this.protect(() => {
+            this.exports.freeQuery(handle);
+        });
+    }
+
+    // Page sizes for connections queried without first or last, and the
+    // largest page a query may request. 0 means unlimited.
+    setConnectionLimits(defaultPageSize: number, maxPageSize: number) {
+        this.protect(() => {
+            this.exports.setConnectionLimits(defaultPageSize, maxPageSize);
+        });
+    }
+
+    // Results are cached per head block, within a memory budget (bytes).
+    // 0 disables the cache.
+    setQueryCacheSize(maxBytes: number) {
+        this.protect(() => {
+            this.exports.setQueryCacheSize(maxBytes);
+        });
+    }
+
+    getQueryCacheStats(): {
+        hits: number;
+        misses: number;
+        entries: number;
+        bytes: number;
+        max_bytes: number;
+    } {
+        return this.protect(() => {
+            this.exports.getQueryCacheStats();
+            return JSON.parse(this.resultAsString());
+        });
+    }
+
+    setQueryStatsEnabled(enabled: boolean) {
+        this.protect(() => {
+            this.exports.setQueryStatsEnabled(enabled);
+        });
+    }
+
+    // Counters are summed per top-level field. output_bytes and time_us
+    // are 64-bit, so they arrive as strings.
+    getQueryStats(): {
+        queries: number;
+        fields: {
+            field: string;
+            calls: number;
+            index_seeks: number;
+            rows_scanned: number;
+            edges_emitted: number;
+            output_bytes: string;
+            time_us: string;
+        }[];
+    } {
+        return this.protect(() => {
+            this.exports.getQueryStats();
+            return JSON.parse(this.resultAsString());
+        });
+    }
+
+    clearQueryStats() {
+        this.protect(() => {
+            this.exports.clearQueryStats();
+        });
+    }
+
+    // Approximate memory use by table, undo stack, and block log. 64-bit
+    // fields arrive as strings.
+    getMemoryStats(): {
+        tables: {
+            table: string;
+            rows: string;
+            undo_old_values: string;
+            undo_removed_values: string;
+            bytes: string;
+        }[];
+        table_bytes: string;
+        undo_revision_begin: string;
+        undo_revision_end: string;
+        undo_depth: number;
+        block_log_blocks: number;
+        block_log_bytes: string;
+        block_delta_bytes: string;
+        query_cache_bytes: string;
+        wasm_memory_bytes: string;
+    } {
+        return this.protect(() => {
+            this.exports.getMemoryStats();
+            return JSON.parse(this.resultAsString());
+        });
+    }
+
     getIrreversible(): number {
         const q = this.query(`{
             blockLog{